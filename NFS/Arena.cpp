@@ -0,0 +1,67 @@
+#include "Arena.h"
+
+using namespace nfs;
+
+Arena::Arena(u32 _chunkSize) : current({ nullptr, 0 }), chunkSize(_chunkSize == 0 ? 0x10000 : _chunkSize), chunkUsed(0), usedBytes(0), reservedBytes(0) {}
+Arena::~Arena() { clear(); }
+
+u8 *Arena::alloc(u32 size, u32 alignment) {
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	if (size == 0)
+		return nullptr;
+
+	if (alignment == 0)
+		alignment = 1;
+
+	//Big allocations get their own chunk, so the current chunk can still be filled
+
+	if (size > chunkSize / 4) {
+
+		Buffer chunk = newBuffer1(size);
+		chunks.push_back(chunk);
+
+		usedBytes += size;
+		reservedBytes += size;
+		return chunk.data;
+	}
+
+	u32 start = (chunkUsed + alignment - 1) & ~(alignment - 1);
+
+	if (current.data != nullptr && start + size <= current.size) {
+		chunkUsed = start + size;
+		usedBytes += size;
+		return current.data + start;
+	}
+
+	current = newBuffer1(chunkSize);
+	chunks.push_back(current);
+
+	chunkUsed = size;
+	usedBytes += size;
+	reservedBytes += chunkSize;
+	return current.data;
+}
+
+u32 Arena::used() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return usedBytes;
+}
+
+u32 Arena::reserved() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return reservedBytes;
+}
+
+void Arena::clear() {
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	for (Buffer &b : chunks)
+		deleteBuffer(&b);
+
+	chunks.clear();
+	current = { nullptr, 0 };
+	chunkUsed = usedBytes = reservedBytes = 0;
+}
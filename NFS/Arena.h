@@ -0,0 +1,40 @@
+#pragma once
+
+#include "Types.h"
+#include <mutex>
+
+namespace nfs {
+
+	//Hands out memory from big chunks; when a chunk is full, a new one is added instead of moving the old one
+	//So, allocations stay where they are until the arena is cleared or destroyed
+	//Allocating is thread safe
+	class Arena {
+
+	public:
+
+		//chunkSize; size of a chunk, allocations that are bigger get a chunk of their own
+		Arena(u32 chunkSize = 0x10000);
+		~Arena();
+
+		Arena(const Arena &other) = delete;
+		Arena &operator=(const Arena &other) = delete;
+
+		//Allocates 'size' bytes (set to zero), aligned to 'alignment' (a power of two, up to the alignment of malloc)
+		u8 *alloc(u32 size, u32 alignment = 8);
+
+		//Bytes that are allocated and bytes that are reserved by chunks
+		u32 used() const;
+		u32 reserved() const;
+
+		//Deletes all chunks
+		void clear();
+
+	private:
+
+		std::vector<Buffer> chunks;
+		Buffer current;							//Chunk that small allocations are taken from
+		u32 chunkSize, chunkUsed, usedBytes, reservedBytes;
+		mutable std::mutex mutex;
+	};
+
+}
@@ -0,0 +1,822 @@
+#include "Compression.h"
+#include "ThreadPool.h"
+#include <string.h>
+#include <algorithm>
+
+using namespace nfs;
+
+//Reads the header of compressed data; returns its size, or 0 if it isn't a valid header
+static u32 readHeader(Buffer in, CompressionType &type, u32 &size) {
+
+	if (in.data == nullptr || in.size < 5)
+		return 0;
+
+	switch (in.data[0]) {
+
+	case COMPRESSION_LZ10:
+	case COMPRESSION_LZ11:
+	case COMPRESSION_HUFFMAN4:
+	case COMPRESSION_HUFFMAN8:
+	case COMPRESSION_RLE:
+		break;
+
+	default:
+		return 0;
+	}
+
+	type = (CompressionType)in.data[0];
+	size = in.data[1] | (in.data[2] << 8) | (in.data[3] << 16);
+
+	//LZ10 can't decompress 17 bytes (a flag byte and 8 matches) into more than 144 bytes
+	if (type == COMPRESSION_LZ10)
+		return size != 0 && size / 144 <= (in.size - 4) / 17 + 1 ? 4 : 0;
+
+	//RLE can't decompress 2 bytes (a flag byte and the byte) into more than 130 bytes
+	if (type == COMPRESSION_RLE)
+		return size != 0 && size / 130 <= (in.size - 4) / 2 + 1 ? 4 : 0;
+
+	//Huffman is followed by the tree; its size is stored in the first byte, in units of 2 bytes
+	if (type == COMPRESSION_HUFFMAN4 || type == COMPRESSION_HUFFMAN8)
+		return size != 0 && (u32)(4 + (in.data[4] + 1) * 2) <= in.size ? 4 : 0;
+
+	//LZ11 stores sizes that don't fit into 24 bits after the header
+	if (size != 0)
+		return 4;
+
+	if (in.size < 9)
+		return 0;
+
+	size = in.data[4] | (in.data[5] << 8) | (in.data[6] << 16) | ((u32)in.data[7] << 24);
+	return size != 0 ? 8 : 0;
+}
+
+CompressionType nfs::getCompressionType(Buffer in) {
+	CompressionType type;
+	u32 size;
+	return readHeader(in, type, size) != 0 ? type : COMPRESSION_NONE;
+}
+
+u32 nfs::getDecompressedSize(Buffer in) {
+	CompressionType type;
+	u32 size;
+	return readHeader(in, type, size) != 0 ? size : 0;
+}
+
+//Copies 'length' bytes from 'distance' bytes back
+//When the distance is smaller than the length, the match repeats itself; the part that is already written is copied at once, doubling every time
+static inline void copyMatch(u8 *dst, u32 distance, u32 length) {
+
+	const u8 *src = dst - distance;
+
+	if (distance >= length) {
+		memcpy(dst, src, length);
+		return;
+	}
+
+	for (u32 i = 0; i < length; ) {
+
+		u32 n = i + distance;
+
+		if (n > length - i)
+			n = length - i;
+
+		memcpy(dst + i, src, n);
+		i += n;
+	}
+}
+
+//Reads a match; returns the number of bytes it used or 0 if the input ends
+template<CompressionType type>
+static inline u32 readMatch(const u8 *src, u32 available, u32 &length, u32 &distance);
+
+template<>
+inline u32 readMatch<COMPRESSION_LZ10>(const u8 *src, u32 available, u32 &length, u32 &distance) {
+
+	if (available < 2)
+		return 0;
+
+	length = (src[0] >> 4) + 3;
+	distance = (((src[0] & 0xF) << 8) | src[1]) + 1;
+	return 2;
+}
+
+template<>
+inline u32 readMatch<COMPRESSION_LZ11>(const u8 *src, u32 available, u32 &length, u32 &distance) {
+
+	if (available < 2)
+		return 0;
+
+	switch (src[0] >> 4) {
+
+	case 0:
+
+		if (available < 3)
+			return 0;
+
+		length = (((src[0] & 0xF) << 4) | (src[1] >> 4)) + 0x11;
+		distance = (((src[1] & 0xF) << 8) | src[2]) + 1;
+		return 3;
+
+	case 1:
+
+		if (available < 4)
+			return 0;
+
+		length = (((src[0] & 0xF) << 12) | (src[1] << 4) | (src[2] >> 4)) + 0x111;
+		distance = (((src[2] & 0xF) << 8) | src[3]) + 1;
+		return 4;
+
+	default:
+		length = (src[0] >> 4) + 1;
+		distance = (((src[0] & 0xF) << 8) | src[1]) + 1;
+		return 2;
+	}
+}
+
+//Bounds are checked once per flag byte or match; literals and matches are copied with memcpy
+template<CompressionType type>
+static bool decode(const u8 *src, const u8 *srcEnd, u8 *dst, u8 *dstEnd) {
+
+	u8 *dstStart = dst;
+
+	while (dst < dstEnd) {
+
+		if (src >= srcEnd)
+			return false;
+
+		u8 flags = *src++;
+
+		//Eight literals; common for data that doesn't compress well
+		if (flags == 0 && srcEnd - src >= 8 && dstEnd - dst >= 8) {
+			memcpy(dst, src, 8);
+			src += 8;
+			dst += 8;
+			continue;
+		}
+
+		for (u32 bit = 0; bit < 8 && dst < dstEnd; ++bit, flags <<= 1) {
+
+			if (!(flags & 0x80)) {
+
+				if (src >= srcEnd)
+					return false;
+
+				*dst++ = *src++;
+				continue;
+			}
+
+			u32 length, distance;
+			u32 used = readMatch<type>(src, (u32)(srcEnd - src), length, distance);
+
+			if (used == 0 || distance > (u32)(dst - dstStart))
+				return false;
+
+			src += used;
+
+			//The last match can go past the end when only the start is decompressed
+			if (length > (u32)(dstEnd - dst))
+				length = (u32)(dstEnd - dst);
+
+			copyMatch(dst, distance, length);
+			dst += length;
+		}
+	}
+
+	return true;
+}
+
+//RLE; runs are written with memset and copied bytes with memcpy
+static bool decodeRle(const u8 *src, const u8 *srcEnd, u8 *dst, u8 *dstEnd) {
+
+	while (dst < dstEnd) {
+
+		if (src >= srcEnd)
+			return false;
+
+		u8 flag = *src++;
+		u32 length = flag & 0x80 ? (flag & 0x7F) + 3 : (flag & 0x7F) + 1;
+
+		if (length > (u32)(dstEnd - dst))
+			length = (u32)(dstEnd - dst);
+
+		if (flag & 0x80) {
+
+			if (src >= srcEnd)
+				return false;
+
+			memset(dst, *src++, length);
+
+		} else {
+
+			if (length > (u32)(srcEnd - src))
+				return false;
+
+			memcpy(dst, src, length);
+			src += length;
+		}
+
+		dst += length;
+	}
+
+	return true;
+}
+
+//Huffman
+
+//The tree is stored after the header; every node has two children that are either a node or a symbol
+//A node is a byte; the children are at (address & ~1) + offset * 2 + 2 (+1 for the second child)
+//Bit 7 is set if the first child is a symbol, bit 6 if the second one is and bit 0-5 are the offset
+class HuffmanTree {
+
+public:
+
+	static const u32 root = 5;
+	static const u32 symbol = 0x10000;			//Set if step found a symbol
+
+	HuffmanTree(Buffer in, u32 symbolBits) : data(in.data), end(4 + (in.data[4] + 1) * 2), mask((1 << symbolBits) - 1) {}
+
+	//Follows a bit from the node at 'address'; returns the next node, the symbol | HuffmanTree::symbol or 0 if the tree is invalid
+	u32 step(u32 address, u32 bit) const {
+
+		u8 node = data[address];
+		u32 child = (address & ~1) + (node & 0x3F) * 2 + 2 + bit;
+
+		if (child >= end)
+			return 0;
+
+		if (node & (0x80 >> bit))
+			return symbol | (data[child] & mask);
+
+		return child;
+	}
+
+	u32 getEnd() const { return end; }
+
+private:
+
+	const u8 *data;
+	u32 end, mask;
+};
+
+//Decodes the next tableBits bits at once; an entry has all symbols that end in those bits
+struct HuffmanEntry {
+	u8 count;									//Symbols in the entry; 0 if the first code is longer than tableBits
+	u8 bits;									//Bits that are used by the symbols
+	u16 node;									//If count is 0; node after tableBits bits, 0 if the bits are invalid
+	u8 symbols[4];
+};
+
+//Reads the stream as 32-bit words, starting at the most significant bit; the bits are kept at the top of a 64-bit buffer
+class HuffmanBits {
+
+public:
+
+	HuffmanBits(const u8 *_src, const u8 *_srcEnd) : src(_src), srcEnd(_srcEnd), bits(0), count(0) {}
+
+	//Makes sure there are more than 32 bits, if the stream doesn't end; the last word can be cut off
+	void refill() {
+
+		if (count > 32 || src >= srcEnd)
+			return;
+
+		u32 word;
+
+		if (srcEnd - src >= 4)
+			memcpy(&word, src, 4);
+		else {
+			u8 last[4] = {};
+			memcpy(last, src, srcEnd - src);
+			memcpy(&word, last, 4);
+		}
+
+		src = srcEnd - src >= 4 ? src + 4 : srcEnd;
+		bits |= (u64)word << (32 - count);
+		count += 32;
+	}
+
+	u32 peek(u32 n) const { return (u32)(bits >> (64 - n)); }
+	void skip(u32 n) { bits <<= n; count -= n; }
+	u32 available() const { return count; }
+
+private:
+
+	const u8 *src, *srcEnd;
+	u64 bits;
+	u32 count;
+};
+
+template<u32 symbolBits>
+static bool decodeHuffman(Buffer in, u8 *dst, u8 *dstEnd) {
+
+	HuffmanTree tree(in, symbolBits);
+	u32 symbols = (u32)(dstEnd - dst) * (8 / symbolBits);
+
+	///Build the table; walks the tree for every value of tableBits bits
+	///Small files use a smaller table, since building it takes longer than decoding them
+
+	u32 tableBits = symbols < 0x4000 ? 8 : 10;
+	std::vector<HuffmanEntry> table((size_t)1 << tableBits);
+
+	for (u32 i = 0; i < (u32)table.size(); ++i) {
+
+		HuffmanEntry &entry = table[i];
+		entry = {};
+
+		u32 node = HuffmanTree::root;
+
+		for (u32 j = 0; j < tableBits; ++j) {
+
+			node = tree.step(node, (i >> (tableBits - 1 - j)) & 1);
+
+			if (node == 0)
+				break;
+
+			if (node & HuffmanTree::symbol) {
+
+				entry.symbols[entry.count++] = (u8)node;
+				entry.bits = (u8)(j + 1);
+				node = HuffmanTree::root;
+
+				if (entry.count == 4)
+					break;
+			}
+		}
+
+		if (entry.count == 0)
+			entry.node = (u16)node;
+	}
+
+	///Decode the symbols; nibbles are stored in the low bits first
+
+	HuffmanBits bits(in.data + tree.getEnd(), in.data + in.size);
+
+	auto write = [dst](u32 i, u8 value) {
+		if (symbolBits == 8)
+			dst[i] = value;
+		else if (i & 1)
+			dst[i >> 1] |= value << 4;
+		else
+			dst[i >> 1] = value;
+	};
+
+	for (u32 i = 0; i < symbols; ) {
+
+		bits.refill();
+
+		if (bits.available() == 0)
+			return false;
+
+		const HuffmanEntry &entry = table[bits.peek(tableBits)];
+
+		//Fast path; all symbols in the next tableBits bits
+
+		if (entry.count != 0 && entry.bits <= bits.available()) {
+
+			for (u32 j = 0; j < entry.count && i < symbols; ++j)
+				write(i++, entry.symbols[j]);
+
+			bits.skip(entry.bits);
+			continue;
+		}
+
+		//Long codes continue where the table stopped; the end of the stream is walked bit by bit
+
+		u32 node = HuffmanTree::root;
+
+		if (entry.count == 0 && bits.available() >= tableBits) {
+
+			if (entry.node == 0)
+				return false;
+
+			node = entry.node;
+			bits.skip(tableBits);
+		}
+
+		while (true) {
+
+			if (bits.available() == 0) {
+
+				bits.refill();
+
+				if (bits.available() == 0)
+					return false;
+			}
+
+			node = tree.step(node, bits.peek(1));
+			bits.skip(1);
+
+			if (node == 0)
+				return false;
+
+			if (node & HuffmanTree::symbol) {
+				write(i++, (u8)node);
+				break;
+			}
+		}
+	}
+
+	return true;
+}
+
+bool nfs::decompress(Buffer in, Buffer out) {
+
+	CompressionType type;
+	u32 size;
+	u32 headerSize = readHeader(in, type, size);
+
+	if (headerSize == 0 || out.data == nullptr)
+		return false;
+
+	const u8 *src = in.data + headerSize, *srcEnd = in.data + in.size;
+	u8 *dst = out.data, *dstEnd = out.data + (out.size < size ? out.size : size);
+
+	switch (type) {
+
+	case COMPRESSION_LZ10:
+		return decode<COMPRESSION_LZ10>(src, srcEnd, dst, dstEnd);
+
+	case COMPRESSION_LZ11:
+		return decode<COMPRESSION_LZ11>(src, srcEnd, dst, dstEnd);
+
+	case COMPRESSION_HUFFMAN4:
+		return decodeHuffman<4>(in, dst, dstEnd);
+
+	case COMPRESSION_HUFFMAN8:
+		return decodeHuffman<8>(in, dst, dstEnd);
+
+	case COMPRESSION_RLE:
+		return decodeRle(src, srcEnd, dst, dstEnd);
+
+	default:
+		return false;
+	}
+}
+
+Buffer nfs::decompress(Buffer in) {
+
+	u32 size = getDecompressedSize(in);
+
+	if (size == 0)
+		return { nullptr, 0 };
+
+	Buffer out = newBuffer1(size);
+
+	if (out.data == nullptr || !decompress(in, out))
+		deleteBuffer(&out);
+
+	return out;
+}
+
+std::vector<Buffer> nfs::decompress(const std::vector<Buffer> &in, Arena &memory, ThreadPool &pool) {
+
+	std::vector<Buffer> out(in.size(), { nullptr, 0 });
+
+	//The sizes are in the headers, so every file gets its place in one allocation before decompressing
+
+	std::vector<u32> offsets(in.size());
+	u64 total = 0;
+
+	for (u32 i = 0; i < (u32)in.size(); ++i) {
+
+		offsets[i] = (u32)total;
+		out[i].size = getDecompressedSize(in[i]);
+		total += (out[i].size + 3) & ~3;
+	}
+
+	if (total == 0 || total > 0xFFFFFFFF)
+		return std::vector<Buffer>(in.size(), { nullptr, 0 });
+
+	u8 *data = memory.alloc((u32)total, 4);
+
+	if (data == nullptr)
+		return std::vector<Buffer>(in.size(), { nullptr, 0 });
+
+	for (u32 i = 0; i < (u32)in.size(); ++i)
+		if (out[i].size != 0)
+			out[i].data = data + offsets[i];
+
+	//Big files are started first, so they aren't the last thing that is left
+
+	std::vector<u32> order(in.size());
+
+	for (u32 i = 0; i < order.size(); ++i)
+		order[i] = i;
+
+	std::stable_sort(order.begin(), order.end(), [&out](u32 a, u32 b) -> bool { return out[a].size > out[b].size; });
+
+	pool.parallelFor((u32)order.size(), [&](u32 i, u32) {
+
+		Buffer &b = out[order[i]];
+
+		if (b.size != 0 && !decompress(in[order[i]], b))
+			b = { nullptr, 0 };
+	});
+
+	return out;
+}
+
+std::vector<Buffer> nfs::decompress(const std::vector<Buffer> &in, Arena &memory, u32 threads) {
+	ThreadPool pool(threads);
+	return decompress(in, memory, pool);
+}
+
+//Compression
+
+//Finds matches in the last 4 KiB; every position is added to the chain of the hash of its first 3 bytes
+class MatchFinder {
+
+public:
+
+	MatchFinder(Buffer in, u32 maxLength, u32 maxChain) : in(in), maxLength(maxLength), maxChain(maxChain), head(1 << hashBits, u32_MAX), prev(in.size, u32_MAX), next(0) {}
+
+	//Adds every position before i
+	void skip(u32 i) {
+
+		for (; next < i; ++next) {
+
+			if (next + 3 > in.size)
+				continue;
+
+			u32 h = hash(next);
+			prev[next] = head[h];
+			head[h] = next;
+		}
+	}
+
+	//Finds the longest match at i; returns its length (0 if there is none of at least 3 bytes)
+	u32 find(u32 i, u32 &distance) {
+
+		skip(i);
+
+		if (i + 3 > in.size)
+			return 0;
+
+		u32 limit = in.size - i < maxLength ? in.size - i : maxLength;
+		u32 best = 2;
+
+		u32 chain = 0;
+
+		for (u32 j = head[hash(i)]; j != u32_MAX && chain < maxChain; j = prev[j], ++chain) {
+
+			u32 d = i - j;
+
+			if (d > 0x1000)
+				break;
+
+			if (d < 2 || in.data[j + best] != in.data[i + best])
+				continue;
+
+			u32 length = matchLength(in.data + j, in.data + i, limit);
+
+			if (length > best) {
+
+				best = length;
+				distance = d;
+
+				if (length == limit)
+					break;
+			}
+		}
+
+		return best >= 3 ? best : 0;
+	}
+
+private:
+
+	static const u32 hashBits = 15;
+
+	u32 hash(u32 i) const {
+		u32 v = in.data[i] | (in.data[i + 1] << 8) | (in.data[i + 2] << 16);
+		return (v * 2654435761U) >> (32 - hashBits);
+	}
+
+	//Compares 8 bytes at a time; the match can overlap with i
+	static u32 matchLength(const u8 *a, const u8 *b, u32 limit) {
+
+		u32 length = 0;
+
+		for (; length + 8 <= limit; length += 8) {
+
+			u64 x, y;
+			memcpy(&x, a + length, 8);
+			memcpy(&y, b + length, 8);
+
+			if (x != y)
+				break;
+		}
+
+		while (length < limit && a[length] == b[length])
+			++length;
+
+		return length;
+	}
+
+	Buffer in;
+	u32 maxLength, maxChain;
+	std::vector<u32> head, prev;
+	u32 next;
+};
+
+//A literal (length 0) or a match
+struct Token {
+	u32 length, distance;
+};
+
+//Bits needed to store a match, including its flag
+static u32 matchCost(CompressionType type, u32 length) {
+
+	if (type == COMPRESSION_LZ10 || length <= 0x10)
+		return 17;
+
+	return length <= 0x110 ? 25 : 33;
+}
+
+static std::vector<Token> parseGreedy(Buffer in, CompressionType type, CompressionLevel level) {
+
+	u32 maxLength = type == COMPRESSION_LZ10 ? 0x12 : 0x10110;
+	MatchFinder finder(in, maxLength, level == COMPRESSION_FAST ? 4 : 64);
+
+	std::vector<Token> tokens;
+
+	for (u32 i = 0; i < in.size; ) {
+
+		u32 distance = 0;
+		u32 length = finder.find(i, distance);
+
+		//Lazy matching; a literal is better if the next byte starts a longer match
+		if (length != 0 && level != COMPRESSION_FAST && length < maxLength) {
+
+			u32 nextDistance = 0;
+
+			if (finder.find(i + 1, nextDistance) > length)
+				length = 0;
+		}
+
+		if (length == 0) {
+			tokens.push_back({ 0, 0 });
+			++i;
+			continue;
+		}
+
+		tokens.push_back({ length, distance });
+		i += length;
+	}
+
+	return tokens;
+}
+
+//Finds the longest match at every position and picks the cheapest way to get to the end from every position, starting at the end
+//Every shorter part of a match is a match as well; long LZ11 matches only try the lengths where their cost changes
+static std::vector<Token> parseOptimal(Buffer in, CompressionType type) {
+
+	u32 n = in.size;
+	u32 maxLength = type == COMPRESSION_LZ10 ? 0x12 : 0x10110;
+	MatchFinder finder(in, maxLength, 512);
+
+	std::vector<u32> lengths(n), distances(n);
+
+	for (u32 i = 0; i < n; ++i)
+		lengths[i] = finder.find(i, distances[i]);
+
+	std::vector<u32> cost(n + 1, 0), choice(n, 0);
+
+	for (u32 i = n; i-- > 0; ) {
+
+		cost[i] = cost[i + 1] + 9;
+		choice[i] = 0;
+
+		u32 longest = lengths[i];
+
+		for (u32 l = 3; l <= longest; l = l < 0x110 || l == longest ? l + 1 : longest) {
+
+			u32 c = cost[i + l] + matchCost(type, l);
+
+			if (c < cost[i]) {
+				cost[i] = c;
+				choice[i] = l;
+			}
+		}
+	}
+
+	std::vector<Token> tokens;
+
+	for (u32 i = 0; i < n; ) {
+
+		if (choice[i] == 0) {
+			tokens.push_back({ 0, 0 });
+			++i;
+			continue;
+		}
+
+		tokens.push_back({ choice[i], distances[i] });
+		i += choice[i];
+	}
+
+	return tokens;
+}
+
+Buffer nfs::compress(Buffer in, CompressionType type, CompressionLevel level) {
+
+	if (in.data == nullptr || in.size == 0 || (type != COMPRESSION_LZ10 && type != COMPRESSION_LZ11))
+		return { nullptr, 0 };
+
+	if (type == COMPRESSION_LZ10 && in.size > 0xFFFFFF)
+		return { nullptr, 0 };
+
+	std::vector<Token> tokens = level == COMPRESSION_OPTIMAL ? parseOptimal(in, type) : parseGreedy(in, type, level);
+
+	///Write header
+
+	std::vector<u8> out;
+	out.reserve(8 + in.size + in.size / 8 + 1);
+
+	if (in.size <= 0xFFFFFF) {
+		u8 header[4] = { (u8)type, (u8)in.size, (u8)(in.size >> 8), (u8)(in.size >> 16) };
+		out.insert(out.end(), header, header + 4);
+	}
+	else {
+		u8 header[8] = { (u8)type, 0, 0, 0, (u8)in.size, (u8)(in.size >> 8), (u8)(in.size >> 16), (u8)(in.size >> 24) };
+		out.insert(out.end(), header, header + 8);
+	}
+
+	///Write blocks of 8 tokens; every block starts with a byte that has a bit per token
+
+	u32 src = 0;
+
+	for (u32 t = 0; t < tokens.size(); t += 8) {
+
+		u32 flagPos = (u32)out.size();
+		u8 flags = 0;
+		out.push_back(0);
+
+		for (u32 k = 0; k < 8 && t + k < tokens.size(); ++k) {
+
+			Token token = tokens[t + k];
+
+			if (token.length == 0) {
+				out.push_back(in.data[src++]);
+				continue;
+			}
+
+			flags |= 0x80 >> k;
+			src += token.length;
+
+			u32 d = token.distance - 1;
+
+			if (type == COMPRESSION_LZ10) {
+				out.push_back((u8)(((token.length - 3) << 4) | (d >> 8)));
+				out.push_back((u8)d);
+			}
+			else if (token.length <= 0x10) {
+				out.push_back((u8)(((token.length - 1) << 4) | (d >> 8)));
+				out.push_back((u8)d);
+			}
+			else if (token.length <= 0x110) {
+				u32 l = token.length - 0x11;
+				out.push_back((u8)(l >> 4));
+				out.push_back((u8)(((l & 0xF) << 4) | (d >> 8)));
+				out.push_back((u8)d);
+			}
+			else {
+				u32 l = token.length - 0x111;
+				out.push_back((u8)(0x10 | (l >> 12)));
+				out.push_back((u8)(l >> 4));
+				out.push_back((u8)(((l & 0xF) << 4) | (d >> 8)));
+				out.push_back((u8)d);
+			}
+		}
+
+		out[flagPos] = flags;
+	}
+
+	//The BIOS reads compressed data in words
+	while (out.size() % 4 != 0)
+		out.push_back(0);
+
+	return newBuffer3(out.data(), (u32)out.size());
+}
+
+std::vector<Buffer> nfs::compress(const std::vector<Buffer> &in, CompressionType type, CompressionLevel level, ThreadPool &pool) {
+
+	std::vector<Buffer> out(in.size(), { nullptr, 0 });
+
+	//Files are independent, so every file is a task; big files are started first, so they aren't the last thing that is left
+
+	std::vector<u32> order(in.size());
+
+	for (u32 i = 0; i < order.size(); ++i)
+		order[i] = i;
+
+	std::stable_sort(order.begin(), order.end(), [&in](u32 a, u32 b) -> bool { return in[a].size > in[b].size; });
+
+	pool.parallelFor((u32)order.size(), [&](u32 i, u32) {
+		out[order[i]] = compress(in[order[i]], type, level);
+	});
+
+	return out;
+}
+
+std::vector<Buffer> nfs::compress(const std::vector<Buffer> &in, CompressionType type, CompressionLevel level, u32 threads) {
+	ThreadPool pool(threads);
+	return compress(in, type, level, pool);
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "Types.h"
+#include "Arena.h"
+
+namespace nfs {
+
+	class ThreadPool;
+
+	//Compression of the DS BIOS; stored in the first byte of compressed data, followed by the decompressed size (24 bits)
+	enum CompressionType {
+		COMPRESSION_NONE = 0x00,
+		COMPRESSION_LZ10 = 0x10,				//LZ77; up to 18 bytes from the last 4 KiB
+		COMPRESSION_LZ11 = 0x11,				//LZ77 with longer lengths; up to 65808 bytes from the last 4 KiB
+		COMPRESSION_HUFFMAN4 = 0x24,			//Huffman coded nibbles
+		COMPRESSION_HUFFMAN8 = 0x28,			//Huffman coded bytes
+		COMPRESSION_RLE = 0x30					//Runs of 3-130 times the same byte and 1-128 bytes that are copied
+	};
+
+	//How hard compress looks for a short encoding
+	enum CompressionLevel {
+		COMPRESSION_FAST = 0,					//First good match of a short hash chain
+		COMPRESSION_NORMAL = 1,					//Longest match of the hash chain; a match is skipped if the next byte starts a longer one
+		COMPRESSION_OPTIMAL = 2					//Longest match of a long hash chain at every byte; picks the matches that give the smallest output
+	};
+
+	//Gets the compression from the header; COMPRESSION_NONE if the buffer doesn't start with a valid header
+	//The header can match by accident, so check if the decompressed data makes sense
+	CompressionType getCompressionType(Buffer in);
+
+	//Size of the data once it is decompressed; 0 if it isn't compressed
+	u32 getDecompressedSize(Buffer in);
+
+	//Decompresses 'in' into 'out'; stops once out is full, so out can also be smaller than the decompressed size
+	//Returns false if 'in' isn't compressed or if it ends (or is invalid) before out is full
+	bool decompress(Buffer in, Buffer out);
+
+	//Decompresses 'in' into a new buffer (see deleteBuffer); a null buffer if it couldn't be decompressed
+	Buffer decompress(Buffer in);
+
+	//Decompresses every buffer on the threads of 'pool' into one allocation of 'memory'
+	//out[i] is a null buffer if in[i] couldn't be decompressed
+	//The pool can be used by other threads at the same time; this only waits for its own tasks (see ThreadPool::Group)
+	std::vector<Buffer> decompress(const std::vector<Buffer> &in, Arena &memory, ThreadPool &pool);
+
+	//Decompresses every buffer on 'threads' threads; 0 uses one per hardware thread
+	std::vector<Buffer> decompress(const std::vector<Buffer> &in, Arena &memory, u32 threads = 0);
+
+	//Compresses 'in' into a new buffer (see deleteBuffer); a null buffer if 'in' is empty, too big or the type isn't LZ10 or LZ11
+	//Matches are at least 2 bytes back, so the BIOS can decompress the data straight into VRAM
+	Buffer compress(Buffer in, CompressionType type, CompressionLevel level = COMPRESSION_NORMAL);
+
+	//Compresses every buffer on the threads of 'pool'
+	//The pool can be used by other threads at the same time; this only waits for its own tasks (see ThreadPool::Group)
+	std::vector<Buffer> compress(const std::vector<Buffer> &in, CompressionType type, CompressionLevel level, ThreadPool &pool);
+
+	//Compresses every buffer on 'threads' threads; 0 uses one per hardware thread
+	std::vector<Buffer> compress(const std::vector<Buffer> &in, CompressionType type, CompressionLevel level = COMPRESSION_NORMAL, u32 threads = 0);
+
+}
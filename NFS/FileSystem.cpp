@@ -1,572 +1,2075 @@
 #include "FileSystem.h"
 #include "Timer.h"
-#include <future>
+#include "ThreadPool.h"
+#include "Compression.h"
+#include <algorithm>
 using namespace nfs;
 
-FileSystem::FileSystem(std::vector<FileSystemObject> &_files, std::vector<GenericResourceBase*> &resources, Buffer buf, u32 _folderc, u32 _filec) : NArchive(resources, buf), files(_files), fileC(_filec), folderC(_folderc){ }
+FileSystemSource::FileSystemSource(std::string path) : reader(new RomReader(path)), rom({ nullptr, 0 }) {}
+FileSystemSource::FileSystemSource(Buffer _rom) : rom(_rom) {}
 
-FileSystem::FileSystem() {}
+FileSystemSource::~FileSystemSource() {
 
-const FileSystemObject &FileSystem::operator[](std::string str) const {
+	//Files of a ROM in memory aren't owned by the source
+	if (reader != nullptr)
+		for (Buffer &b : loaded)
+			deleteBuffer(&b);
+}
 
-	const FileSystemObject *ptr = nullptr;
-	for (u32 i = 0; i < files.size(); ++i)
-		if (files[i].path == str || files[i].name == str) {
-			ptr = &files[i];
-			break;
-		}
+Buffer FileSystemSource::read(u32 resource, u32 size) {
 
-	if (ptr == nullptr)
-		throw(std::exception(std::string("Couldn't find file with path \"").append(str).append("\"").c_str()));
+	if (resource >= offsets.size())
+		return { nullptr, 0 };
 
-	return *ptr;
-}
+	if (reader != nullptr)
+		return reader->read(offsets[resource], size);
 
-std::vector<const FileSystemObject*> FileSystem::operator[](const FileSystemObject &fso) const {
+	Buffer file = offset(rom, offsets[resource]);
 
-	auto iter = std::find(files.begin(), files.end(), fso);
+	if (file.data == nullptr || file.size < size)
+		return { nullptr, 0 };
 
-	std::vector<const FileSystemObject*> filesInFolder;
+	file.size = size;
+	return file;
+}
+
+FileSystem::FileSystem(std::shared_ptr<FileTable> _table, std::vector<GenericResourceBase*> &resources, Buffer buf, u32 _folderc, u32 _filec, std::shared_ptr<FileSystemSource> _source, std::shared_ptr<FileSystemArchives> _archives, std::shared_ptr<Arena> _memory, std::shared_ptr<FileSystemDiagnostics> _diagnostics) : NArchive(resources, buf), table(_table), fileC(_filec), folderC(_folderc), source(_source), archives(_archives), diagnostics(_diagnostics != nullptr ? _diagnostics : std::make_shared<FileSystemDiagnostics>()), palettes(std::make_shared<FileSystemPalettes>()) {
+
+	memory = _memory != nullptr ? _memory : std::make_shared<Arena>();
+	share();
 
-	if (iter == files.end()) {
-		throw("Couldn't find file in file system");
-		return filesInFolder;
+	if (source != nullptr || archives != nullptr) {
+		stored = std::make_shared<FileSystemResources>();
+		stored->ptrs = NArchive::resources;
 	}
 
-	u32 id = (u32)(iter - files.begin());
+	//Sub files of NARCs that aren't expanded yet don't have a name, unless they were loaded from an index
+	table->buildIndex(archives != nullptr && !archives->named ? archives->start : u32_MAX);
+
+	files.resize(table->size());
 
 	for (u32 i = 0; i < files.size(); ++i)
-		if (files[i].parent == id)
-			filesInFolder.push_back(&files[i]);
+		files[i] = { table.get(), i };
+}
 
-	return filesInFolder;
+FileSystem::FileSystem() : table(std::make_shared<FileTable>()), fileC(0), folderC(0), diagnostics(std::make_shared<FileSystemDiagnostics>()), palettes(std::make_shared<FileSystemPalettes>()) {
+	memory = std::make_shared<Arena>();
 }
 
-std::vector<const FileSystemObject*> FileSystem::traverseFolder(const FileSystemObject &fso, bool includeDirs) const {
+FileSystem::FileSystem(const FileSystem &other) : NArchive(other), table(other.table), files(other.files), folderC(other.folderC), fileC(other.fileC), source(other.source), archives(other.archives), stored(other.stored), diagnostics(other.diagnostics), palettes(other.palettes) {}
 
-	auto iter = std::find(files.begin(), files.end(), fso);
+FileSystem &FileSystem::operator=(const FileSystem &other) {
 
-	std::vector<const FileSystemObject*> filesInFolder;
+	if (this != &other) {
 
-	if (iter == files.end()) {
-		throw("Couldn't find file in file system");
-		return filesInFolder;
+		NArchive::operator=(other);
+
+		table = other.table;
+		files = other.files;
+		folderC = other.folderC;
+		fileC = other.fileC;
+		source = other.source;
+		archives = other.archives;
+		stored = other.stored;
+		diagnostics = other.diagnostics;
+		palettes = other.palettes;
 	}
 
-	u32 id = (u32)(iter - files.begin());
+	return *this;
+}
+
+void FileSystemDiagnostics::add(u32 file, u32 magicNumber, const char *reason) {
+	std::lock_guard<std::mutex> lock(mutex);
+	list.push_back({ file, magicNumber, reason });
+}
 
-	for (u32 i = 0; i < files.size(); ++i)
-		if (files[i].isFile() || includeDirs)
-			if (files[i].parent == id)
-				filesInFolder.push_back(&files[i]);
-			else {
-				u32 parent = files[i].parent;
-				while (parent != u32_MAX) {
-					if (parent == id) {
-						filesInFolder.push_back(&files[i]);
-						break;
-					}
-					parent = files[parent].parent;
-				}
-			}
+FileSystemArchives::FileSystemArchives(u32 count) : archives(count), firstChild(count), firstResource(count), once(new std::once_flag[count]), start(0), named(false) {}
 
-			return filesInFolder;
+//FileTable
+
+static std::string getExtension(const std::string &name) {
+
+	size_t pos = name.find_last_of('.');
+	if (pos == std::string::npos || pos == name.size() - 1)
+		return "";
+
+	std::string ext = std::string(name.c_str() + pos + 1, name.size() - 1 - pos);
+	for (u32 i = 0; i < ext.size(); ++i)
+		ext[i] = toupper(ext[i]);
+	return ext;
 }
 
-std::vector<FileSystemObject>::const_iterator FileSystem::begin() { return files.begin(); }
-std::vector<FileSystemObject>::const_iterator FileSystem::end() { return files.end(); }
-u32 FileSystem::getFileObjectCount() { return (u32)files.size(); }
-u32 FileSystem::getFileCount() { return fileC; } 
-u32 FileSystem::getFolderCount() { return folderC; }
+FileTable::FileTable() {
+	typeNames.push_back("");
+	typeNameIds[""] = 0;
+}
 
-const FileSystemObject &FileSystem::operator[](u32 i) {
-	if (i >= files.size())
-		throw(std::exception("Out of bounds"));
-	return files[i];
+u32 FileTable::size() const { return (u32)parents.size(); }
+
+void FileTable::resize(u32 n) {
+	parents.resize(n, u32_MAX);
+	resources.resize(n, u32_MAX);
+	buffers.resize(n, { nullptr, 0 });
+	compressed.resize(n, { nullptr, 0 });
+	nameOffsets.resize(n, 0);
+	nameLengths.resize(n, 0);
+	pathHashes.resize(n, 0);
+	indexInFolder.resize(n, 0);
+	types.resize(n, 0);
+	magicNumbers.resize(n, 0);
+	typeIds.resize(n, u32_MAX);
+	validTypes.resize(n, 0);
 }
 
+u32 FileTable::push(u32 parent, u32 resource, Buffer buffer) {
+	u32 i = size();
+	resize(i + 1);
+	parents[i] = parent;
+	resources[i] = resource;
+	buffers[i] = buffer;
+	return i;
+}
 
-FileSystemObject *FileSystem::foreachInFolder(bool(*f)(const FileSystemObject &fso, u32 i, u32 param), FileSystemObject &start, u32 param) {
+void FileTable::setName(u32 i, const std::string &name) {
+	std::string arena;
+	setName(i, name, arena);
+	moveNames(i, i + 1, arena);
+}
 
-	u32 j = 0;
-	for (u32 i = start.folderHint; i < folderC; ++i)
-		if (files[i].parent == start.index) {
-			if (f(files[i], j, param))
-				return const_cast<FileSystemObject*>(&files[i]);
-			++j;
-		}
+void FileTable::setName(u32 i, const std::string &name, std::string &arena) {
 
-	j = 0;
-	for (u32 i = start.fileHint; i < fileC; ++i)
-		if (files[i].parent == start.index) {
-			if (f(files[i], j + start.folders, param))
-				return const_cast<FileSystemObject*>(&files[i]);
-			++j;
-		}
+	nameOffsets[i] = (u32)arena.size();
+	nameLengths[i] = (u32)name.size();
+	arena += name;
 
-	return nullptr;
+	//Folders in root don't start with a slash; everything else is parent + "/" + name (see getPath)
+
+	u32 parent = parents[i];
+	u32 start = hash(nullptr, 0);
+
+	if (parent < size() && !(isFolder(i) && isRoot(parent)))
+		start = hash("/", 1, pathHashes[parent]);
+
+	pathHashes[i] = hash(name.c_str(), (u32)name.size(), start);
 }
 
-template<class T> bool FileSystem::isFile(T t) {
-	try {
-		const FileSystemObject &obj = (*this)[t];
-		return obj.isFile();
-	}
-	catch (std::exception e) {
-		throw(std::exception(std::string("Couldn't get file (\"").append(e.what()).append("\")").c_str()));
-		return false;
-	}
+void FileTable::moveNames(u32 start, u32 end, std::string &arena) {
+
+	u32 base = (u32)names.size();
+	names.insert(names.end(), arena.begin(), arena.end());
+
+	for (u32 i = start; i < end && i < size(); ++i)
+		nameOffsets[i] += base;
+
+	arena.clear();
 }
 
-template<class T> bool FileSystem::isFolder(T t) {
-	try {
-		const FileSystemObject &obj = (*this)[t];
-		return obj.isFolder();
-	}
-	catch (std::exception e) {
-		throw(std::exception(std::string("Couldn't get file (\"").append(e.what()).append("\")").c_str()));
-		return false;
-	}
+void FileTable::reserveName(u32 i, u32 length) {
+	nameOffsets[i] = (u32)names.size();
+	nameLengths[i] = length;
+	names.insert(names.end(), length, '?');
 }
 
-template<class T> bool FileSystem::isRoot(T t) {
-	try {
-		const FileSystemObject &obj = (*this)[t];
-		return obj.isRoot();
-	}
-	catch (std::exception e) {
-		throw(std::exception(std::string("Couldn't get file (\"").append(e.what()).append("\")").c_str()));
-		return false;
+void FileTable::fillName(u32 i, const std::string &name) {
+
+	//The name is written before its length and hash, so a reader never uses a length or hash of a name that isn't there yet
+
+	u32 length = (u32)name.size() < nameLengths[i] ? (u32)name.size() : nameLengths[i];
+	std::copy(name.begin(), name.begin() + length, names.begin() + nameOffsets[i]);
+	nameLengths[i] = length;
+
+	u32 parent = parents[i];
+	u32 start = hash(nullptr, 0);
+
+	if (parent < size() && !(isFolder(i) && isRoot(parent)))
+		start = hash("/", 1, pathHashes[parent]);
+
+	pathHashes[i] = hash(name.c_str(), length, start);
+}
+
+bool FileTable::isFolder(u32 i) const { return resources[i] >= u32_MAX - 1; }
+bool FileTable::isRoot(u32 i) const { return resources[i] == u32_MAX - 1; }
+
+std::string FileTable::getName(u32 i) const {
+	auto begin = names.begin() + nameOffsets[i];
+	return std::string(begin, begin + nameLengths[i]);
+}
+
+std::string FileTable::getPath(u32 i) const {
+
+	std::vector<u32> chain;
+
+	for (u32 j = i; ; j = parents[j]) {
+
+		chain.push_back(j);
+
+		u32 parent = parents[j];
+
+		if (parent >= size() || (isFolder(j) && isRoot(parent)))
+			break;
 	}
+
+	std::string path = getName(chain.back());
+
+	for (u32 k = (u32)chain.size() - 1; k > 0; --k)
+		path += "/" + getName(chain[k - 1]);
+
+	return path;
 }
 
-bool FileSystemObject::isFolder() const { return resource >= u32_MAX - 1; }
-bool FileSystemObject::isFile() const { return !isFolder(); }
-bool FileSystemObject::isRoot() const { return resource == u32_MAX - 1; }
-bool FileSystemObject::hasParent() const { return resource != u32_MAX - 1; }
-bool FileSystemObject::operator==(const FileSystemObject &other) const {
-	return path == other.path && index == other.index && parent == other.parent && resource == other.resource && name == other.name;
+std::string FileTable::getExtension(u32 i) const {
+	if (isFolder(i)) return "";
+	return ::getExtension(getName(i));
 }
 
-std::string FileSystemObject::getExtension() const {
-	if (!isFile()) return "";
+std::string FileTable::getTypeName(u32 i) const {
+	std::lock_guard<std::mutex> lock(typeMutex);
+	return typeNames[types[i]];
+}
 
-	size_t pos = path.find_last_of('.');
-	if (pos == std::string::npos || pos == path.size() - 1)
-		return "";
+u32 FileTable::getTypeNameId(const std::string &name) {
 
-	std::string ext = std::string(path.c_str() + pos + 1, path.size() - 1 - pos);
-	for (u32 i = 0; i < ext.size(); ++i)
-		ext[i] = toupper(ext[i]);
-	return ext;
+	std::lock_guard<std::mutex> lock(typeMutex);
+
+	auto it = typeNameIds.find(name);
+
+	if (it != typeNameIds.end())
+		return it->second;
+
+	u32 id = (u32)typeNames.size();
+	typeNames.push_back(name);
+	typeNameIds[name] = id;
+	return id;
 }
 
-bool FileSystemObject::getMagicNumber(std::string &name, u32 &number) const {
+void FileTable::detectType(u32 i) {
 
-	if (!isFile()) {
-		name = "";
-		number = 0;
-		return true;
+	if (isFolder(i)) {
+		types[i] = 0;
+		magicNumbers[i] = 0;
+		typeIds[i] = u32_MAX;
+		validTypes[i] = 1;
+		return;
 	}
 
-	u32 magicNumber = 0;
-	std::string extension = getExtension(), extensionReverse = extension, type = extension;
+	detectType(i, getExtension(i));
+}
+
+void FileTable::detectType(u32 i, const std::string &extension) {
+
+	Buffer buffer = buffers[i];
+
+	u32 magic = 0;
+	std::string extensionReverse = extension, typeName = extension;
 	std::reverse(extensionReverse.begin(), extensionReverse.end());
 
-	magicNumber = extension.size() == 4 ? *(u32*)extension.c_str() : 0;
+	magic = extension.size() == 4 ? *(u32*)extension.c_str() : 0;
 
 	bool valid = false;
 
 	try {
-		runArchiveFunction<NType::IsValidType>(magicNumber, ArchiveTypes(), &valid);
+		runArchiveFunction<NType::IsValidType>(magic, ArchiveTypes(), &valid);
 	}
 	catch (std::exception e) {}
 
-	if (!valid && extension != "TXT" && extension != "BIN" && extension != "DAT") {
-		type = std::string((char*)buffer.data, 4);
+	//The contents aren't available for files that haven't been loaded yet (see NType::openNDS); only the extension can be used then
+	bool hasContents = buffer.data != nullptr && buffer.size >= 4;
+
+	//Most resources store their magic number reversed (RLCN for NCLR), so the extension is reversed too
+	if (!valid && !hasContents && extension.size() == 4) {
+
+		u32 reversed = *(u32*)extensionReverse.c_str();
+
+		try {
+			runArchiveFunction<NType::IsValidType>(reversed, ArchiveTypes(), &valid);
+		}
+		catch (std::exception e) {}
+
+		if (valid)
+			magic = reversed;
+	}
+
+	if (!valid && hasContents && extension != "TXT" && extension != "BIN" && extension != "DAT") {
+		typeName = std::string((char*)buffer.data, 4);
 		valid = true;
 
-		if (type != extensionReverse) {
+		if (typeName != extensionReverse) {
 
-			for (u32 i = 0; i < 4; ++i)
-				if (!((type[i] >= 'A' && type[i] <= 'Z') || type[i] == '0'))
+			for (u32 j = 0; j < 4; ++j)
+				if (!((typeName[j] >= 'A' && typeName[j] <= 'Z') || typeName[j] == '0'))
 					valid = false;
 
-			if (valid) 
-				magicNumber = *(u32*)type.c_str();
+			if (valid)
+				magic = *(u32*)typeName.c_str();
 			else
-				type = extension;
+				typeName = extension;
 		}
 		else {
-			magicNumber = *(u32*)type.c_str();
-			type = extension;
+			magic = *(u32*)typeName.c_str();
+			typeName = extension;
 		}
 	}
 
-	name = type;
-	number = magicNumber;
-
 	valid = false;
 
 	try {
-		runArchiveFunction<NType::IsValidType>(magicNumber, ArchiveTypes(), &valid);
+		runArchiveFunction<NType::IsValidType>(magic, ArchiveTypes(), &valid);
 	} catch (std::exception e) {}
 
-	return valid;
+	u32 id = u32_MAX;
+
+	if (valid)
+		runArchiveFunction<NType::TypeId>(magic, ArchiveTypes(), &id);
+
+	types[i] = getTypeNameId(typeName);
+	magicNumbers[i] = magic;
+	typeIds[i] = id;
+	validTypes[i] = valid;
 }
 
-bool NType::convert(NDS nds, FileSystem *fs) {
+u32 FileTable::hash(const char *str, u32 len, u32 start) {
 
-	oi::Timer t;
+	//FNV-1a; can be continued by passing the previous hash as start
 
-	///Find file alloc and name table
+	u32 h = start;
 
-	Buffer fileNames = offset(nds.data, nds.ftable_off - nds.romHeaderSize);
-	fileNames.size = nds.ftable_len;
+	for (u32 i = 0; i < len; ++i)
+		h = (h ^ (u8)str[i]) * 16777619U;
 
-	Buffer filePositions = offset(nds.data, nds.falloc_off - nds.romHeaderSize);
-	filePositions.size = nds.falloc_len;
+	return h;
+}
 
-	if (fileNames.size < sizeof(FolderInfo)) {
-		throw(std::exception("Invalid buffer size"));
-		return false;
+void FileTable::buildIndex(u32 named) {
+
+	{
+		std::lock_guard<std::mutex> lock(indexMutex);
+		pathIndex.clear();
+		nameIndex.clear();
 	}
 
-	///Get root
+	addToIndex(0, named < size() ? named : size());
+	buildChildIndex();
+}
 
-	FolderInfo *folderArray = (FolderInfo*)fileNames.data;
-	FolderInfo &root = folderArray[0];
+void FileTable::addToIndex(u32 start, u32 end) {
 
-	if ((root.relation & 0xF000) != 0) {
-		throw(std::exception("Invalid file table; first folder isn't root"));
-		return false;
-	}
+	std::lock_guard<std::mutex> lock(indexMutex);
 
-	u32 folderArraySize = root.relation;
-	u32 startFile = root.firstFilePosition;
+	pathIndex.reserve(pathIndex.size() + end - start);
+	nameIndex.reserve(nameIndex.size() + end - start);
 
-	if (fileNames.size < sizeof(FolderInfo) * folderArraySize) {
-		throw(std::exception("Out of bounds exception"));
-		return false;
+	for (u32 i = start; i < end; ++i) {
+		pathIndex.insert({ pathHashes[i], i });
+		nameIndex.insert({ hash(names.data() + nameOffsets[i], nameLengths[i]), i });
 	}
+}
 
-	t.lap("Startup");
-	///Get folder info
+u32 FileTable::findPath(const std::string &path) const {
 
-	std::vector<FileSystemObject> fso(folderArraySize);
-	fso.reserve(folderArraySize + 512);
+	std::lock_guard<std::mutex> lock(indexMutex);
 
-	for (u32 i = 0; i < folderArraySize; ++i) {
-		fso[i].index = i;
-		fso[i].resource = i == 0 ? u32_MAX - 1 : u32_MAX;
-		fso[i].parent = i == 0 ? u32_MAX : folderArray[i].relation & 0xFFF;
-		fso[i].count = 0;
-		fso[i].fileHint = fso[i].folderHint = u32_MAX;
+	u32 i = u32_MAX;
+
+	auto paths = pathIndex.equal_range(hash(path.c_str(), (u32)path.size()));
+	for (auto it = paths.first; it != paths.second; ++it)
+		if (it->second < i && getPath(it->second) == path)
+			i = it->second;
+
+	return i;
+}
+
+std::vector<u32> FileTable::findName(const std::string &name) const {
+
+	std::lock_guard<std::mutex> lock(indexMutex);
+
+	std::vector<u32> result;
+
+	auto range = nameIndex.equal_range(hash(name.c_str(), (u32)name.size()));
+	for (auto it = range.first; it != range.second; ++it) {
 
-		if (i == 0)
-			fso[i].path = fso[i].name = "/";
+		u32 i = it->second;
+
+		if (nameLengths[i] == name.size() && std::equal(name.begin(), name.end(), names.begin() + nameOffsets[i]))
+			result.push_back(i);
 	}
 
-	t.lap("Folder info");
-	///Get file info
+	std::sort(result.begin(), result.end());
+	return result;
+}
 
-	Buffer next = offset(fileNames, folderArraySize * sizeof(FolderInfo));
+void FileTable::buildChildIndex() {
 
-	u32 current = 0;
-	u32 i = folderArraySize;
-	u32 fileOffset = startFile;
+	u32 n = size();
 
-	u32 bufferSize = 0;
+	//Count children per object and prefix sum them into offsets
 
-	while (next.size > 0) {
+	folderOffsets.assign(n + 1, 0);
+	fileOffsets.assign(n + 1, 0);
 
-		u32 curr = 0;
-		u8 len = next.data[curr];
-		++curr;
+	for (u32 i = 0; i < n; ++i) {
 
-		bool isFolder = (len & 0x80) != 0;
-		u32 strLen = len & 0x7F;
-		bool jump = len == 0;
+		u32 parent = parents[i];
 
-		if (strLen == 0) {
-			strLen = next.data[curr];
-			isFolder = (strLen & 0x80) != 0;
+		if (parent >= n)
+			continue;
 
-			if (strLen == 0xFF)
-				break;
+		if (isFolder(i))
+			++folderOffsets[parent + 1];
+		else
+			++fileOffsets[parent + 1];
+	}
 
-			strLen = strLen & 0x7F;
+	for (u32 i = 0; i < n; ++i) {
+		folderOffsets[i + 1] += folderOffsets[i];
+		fileOffsets[i + 1] += fileOffsets[i];
+	}
 
-			++curr;
-		}
+	folderChildren.resize(folderOffsets[n]);
+	fileChildren.resize(fileOffsets[n]);
 
-		std::string str;
+	std::vector<u32> folderEnd(folderOffsets.begin(), folderOffsets.end() - 1);
+	std::vector<u32> fileEnd(fileOffsets.begin(), fileOffsets.end() - 1);
 
-		if (strLen != 0) {
-			str = std::string((char*)&next.data[curr], strLen);
-			curr += strLen;
-		}
+	for (u32 i = 0; i < n; ++i) {
 
-		if (jump)
-			++current;
+		u32 parent = parents[i];
 
-		u16 dir = current;
+		if (parent >= n)
+			continue;
 
-		if (isFolder) {
-			dir = (*(u16*)&next.data[curr]) & 0xFFF;
-			curr += 2;
-		}
+		if (isFolder(i))
+			folderChildren[folderEnd[parent]++] = i;
+		else
+			fileChildren[fileEnd[parent]++] = i;
+	}
 
-		if (isFolder) {
-			fso[dir].name = str;
-			fso[dir].files = fso[dir].folders = 0;
-			fso[dir].path = (fso[fso[dir].parent].isRoot() ? "" : (fso[fso[dir].parent].path + "/")) + str;
-			fso[dir].buffer = { nullptr, 0 };
-			fso[dir].indexInFolder = fso[fso[dir].parent].count;
-			
-			if (fso[fso[dir].parent].folderHint == u32_MAX)
-				fso[fso[dir].parent].folderHint = fso[dir].index;
-
-			++fso[fso[dir].parent].folders;
-			++fso[fso[dir].parent].count;
-		}
-		else {
+	//Position in parent
 
-			FileSystemObject fo;
-			fo.name = str;
-			fo.path = fso[current].path + "/" + str;
-			fo.index = i;
-			fo.parent = dir;
-			fo.resource = fileOffset - startFile;
-			fo.files = fo.folders = 0;
-			fo.indexInFolder = fso[current].count;
-			fo.count = 0;
-			fo.folderHint = fo.fileHint = u32_MAX;
+	for (u32 i = 0; i < n; ++i) {
 
-			if (fso[current].fileHint == u32_MAX) 
-				fso[current].fileHint = i;
+		u32 folders = folderOffsets[i + 1] - folderOffsets[i];
 
-			++fso[current].files;
-			++fso[current].count;
+		for (u32 k = folderOffsets[i]; k < folderOffsets[i + 1]; ++k)
+			indexInFolder[folderChildren[k]] = k - folderOffsets[i];
 
-			++i;
+		for (u32 k = fileOffsets[i]; k < fileOffsets[i + 1]; ++k)
+			indexInFolder[fileChildren[k]] = folders + k - fileOffsets[i];
+	}
 
-			u32 &x = *(u32*)(filePositions.data + fileOffset * 8);
-			u32 &y = *(u32*)(filePositions.data + fileOffset * 8 + 4);
-			u32 len = y - x;
+	//Breadth-first order, so subtree sizes can be summed bottom-up and positions assigned top-down
+
+	std::vector<u32> order;
+	order.reserve(n);
+
+	for (u32 i = 0; i < n; ++i)
+		if (parents[i] >= n)
+			order.push_back(i);
+
+	for (u32 j = 0; j < order.size(); ++j) {
+
+		u32 i = order[j];
+
+		for (u32 k = folderOffsets[i]; k < folderOffsets[i + 1]; ++k)
+			order.push_back(folderChildren[k]);
+
+		for (u32 k = fileOffsets[i]; k < fileOffsets[i + 1]; ++k)
+			order.push_back(fileChildren[k]);
+	}
+
+	subtreeSize.assign(n, 1);
+
+	for (u32 j = (u32)order.size(); j > 0; --j) {
+		u32 i = order[j - 1];
+		if (parents[i] < n)
+			subtreeSize[parents[i]] += subtreeSize[i];
+	}
 
-			fo.buffer = offset(nds.data, x - nds.romHeaderSize);
-			fo.buffer.size = len;
+	subtreeStart.assign(n, 0);
+	subtree.assign(order.size(), 0);
 
-			fso.push_back(fo);
+	u32 next = 0;
 
-			std::string name;
-			u32 magicNumber;
-			bool valid = fo.getMagicNumber(name, magicNumber);
+	for (u32 i : order) {
 
-			if (!valid)
-				magicNumber = 0;
+		if (parents[i] >= n) {
+			subtreeStart[i] = next;
+			next += subtreeSize[i];
+		}
 
-			runArchiveFunction<GenericResourceSize>(magicNumber, ArchiveTypes(), &bufferSize);
+		u32 start = subtreeStart[i];
+		subtree[start] = i;
+		++start;
 
-			++fileOffset;
+		for (u32 k = folderOffsets[i]; k < folderOffsets[i + 1]; ++k) {
+			subtreeStart[folderChildren[k]] = start;
+			start += subtreeSize[folderChildren[k]];
 		}
 
-		next = offset(next, curr);
+		for (u32 k = fileOffsets[i]; k < fileOffsets[i + 1]; ++k) {
+			subtreeStart[fileChildren[k]] = start;
+			start += subtreeSize[fileChildren[k]];
+		}
 	}
+}
 
-	t.lap("File info");
-	///Get file resources
+//FileSystem
 
-	u32 totalFiles = (u32)fso.size() - folderArraySize;
-	Buffer resources = newBuffer1(bufferSize);
-	std::vector<GenericResourceBase*> resourcePtrs(totalFiles);
-	u32 bufferOffset = 0;
+u32 FileSystem::find(const FileSystemObject &fso) const {
 
-	u32 subfiles = 0;
-	std::vector<u32> narcs;
+	if (fso.table != table.get() || fso.index >= files.size())
+		throw(std::exception("Couldn't find file in file system"));
 
-	for (u32 i = folderArraySize; i < fso.size(); ++i) {
+	return fso.index;
+}
 
-		FileSystemObject &fo = fso[i];
+u32 FileSystem::lookup(const std::string &str) const {
 
-		std::string name;
-		u32 magicNumber;
-		bool valid = fo.getMagicNumber(name, magicNumber);
+	//Paths and names can both match; the first object in the file system wins
 
-		if (!valid)
-			magicNumber = 0;
+	u32 i = table->findPath(str);
 
-		u8 *at = resources.data + bufferOffset;
-		u32 j = i - folderArraySize;
+	std::vector<u32> names = table->findName(str);
+	if (names.size() != 0 && names[0] < i)
+		i = names[0];
 
-		resourcePtrs[j] = (GenericResourceBase*)at;
+	return i;
+}
 
-		u32 mlen = 0;
-		runArchiveFunction<GenericResourceSize>(magicNumber, ArchiveTypes(), &mlen);
+const FileSystemObject &FileSystem::operator[](std::string str) const {
 
-		try {
-			runArchiveFunction<NFactory>(magicNumber, ArchiveTypes(), (void*)at, fo.buffer);
+	u32 i = lookup(str);
 
-			if (magicNumber == MagicNumber::get<NARC>) {
-				subfiles += ((NARC*)at)->contents.front.files;
-				narcs.push_back(i - folderArraySize);
-				fo.files = subfiles;
-			}
-		}
-		catch (std::exception e) {
+	//The path could point into a NARC that isn't expanded yet; expand the closest parent that exists and try again
 
-			if (mlen >= sizeof(NBUO)) {
-				runArchiveFunction<NFactory>(0, ArchiveTypes(), (void*)at, fo.buffer);
+	if (i == u32_MAX && archives != nullptr)
+		for (size_t slash = str.find_last_of('/'); slash != std::string::npos && slash != 0; slash = str.find_last_of('/', slash - 1)) {
+
+			u32 parent = table->findPath(str.substr(0, slash));
+
+			if (parent != u32_MAX) {
+
+				if (expand(files[parent]))
+					i = lookup(str);
+
+				break;
 			}
-			else
-				memset(at, 0, mlen);
 		}
 
-		bufferOffset += mlen;
-	}
+	if (i == u32_MAX)
+		throw(std::exception(std::string("Couldn't find file with path \"").append(str).append("\"").c_str()));
 
-	t.lap("Resources");
-	///Get sub resources (inside archive)
+	return files[i];
+}
 
-		///Alloc sub Resources
+std::vector<const FileSystemObject*> FileSystem::findByName(std::string name) const {
 
-	u32 biggestResource = 0;
-	lag::RunForType<BiggestResource>::run(ArchiveTypes(), &biggestResource);
+	std::vector<u32> names = table->findName(name);
 
-	fso.resize(fso.size() + subfiles);
-	resourcePtrs.resize(resourcePtrs.size() + subfiles);
+	std::vector<const FileSystemObject*> result(names.size());
 
-	u8 *oldAddr = resources.data;
+	for (u32 i = 0; i < names.size(); ++i)
+		result[i] = &files[names[i]];
 
-	u32 bufferStart = resources.size;
+	return result;
+}
 
-	Buffer nresources = newBuffer1(resources.size + biggestResource * subfiles);
-	memcpy(nresources.data, resources.data, resources.size);
-	deleteBuffer(&resources);
-	resources = nresources;
+std::vector<const FileSystemObject*> FileSystem::operator[](const FileSystemObject &fso) const {
 
-	for (u32 i = 0; i < totalFiles; ++i)
-		resourcePtrs[i] = (GenericResourceBase*)((u8*)resourcePtrs[i] - oldAddr + resources.data);
+	u32 id = find(fso);
+	const FileTable &t = *table;
 
+	expand(fso);
 
-	t.lap("Alloc sub resources");
+	std::vector<const FileSystemObject*> filesInFolder;
+	filesInFolder.reserve(t.folderOffsets[id + 1] - t.folderOffsets[id] + t.fileOffsets[id + 1] - t.fileOffsets[id]);
 
-		///Init sub resources
+	for (u32 k = t.folderOffsets[id]; k < t.folderOffsets[id + 1]; ++k)
+		filesInFolder.push_back(&files[t.folderChildren[k]]);
 
-	u32 threads = std::thread::hardware_concurrency();
-	u32 perThread = subfiles / threads;
-	u32 perThreadr = subfiles - perThread * threads;
+	for (u32 k = t.fileOffsets[id]; k < t.fileOffsets[id + 1]; ++k)
+		filesInFolder.push_back(&files[t.fileChildren[k]]);
 
-	struct FileSystemThread {
+	return filesInFolder;
+}
 
-		std::vector<u32> archives;
-		u32 resourceOff, fsoOff, bufferStart;
+std::vector<const FileSystemObject*> FileSystem::traverseFolder(const FileSystemObject &fso, bool includeDirs) const {
 
-		Buffer resources;
-		std::vector<GenericResourceBase*> *ptrs;
-		std::vector<FileSystemObject> *fsos;
+	u32 id = find(fso);
+	const FileTable &t = *table;
 
-	};
+	expandSubtree(id);
 
-	std::vector<FileSystemThread> thrs(threads);
-	std::vector<std::future<void>> processes(threads);
+	std::vector<const FileSystemObject*> filesInFolder;
 
-	bool run = true;
+	//The subtree range starts with the folder itself
 
-	std::vector<u32> archives;
-	u32 fileC = 0, thrI = 0, fileOff = 0;
+	u32 start = t.subtreeStart[id] + 1, end = t.subtreeStart[id] + t.subtreeSize[id];
+	filesInFolder.reserve(end - start);
 
-	for (u32 i = 0; i < narcs.size(); ++i) {
-		NARC *narc = (NARC*)resourcePtrs[narcs[i]];
-		archives.push_back(narcs[i] + folderArraySize);
-		fileC += narc->contents.front.files;
-		if (fileC >= perThread + (i == narcs.size() - 1 ? perThreadr : 0) || i == narcs.size() - 1) {
-
-			thrs[thrI] = { archives, totalFiles + fileOff, totalFiles + folderArraySize + fileOff, bufferStart + fileOff * biggestResource, resources, &resourcePtrs, &fso };
-
-			processes[thrI] = std::move(std::async([](FileSystemThread fst) -> void {
-
-				u32 delta = fst.fsoOff - fst.resourceOff;
-				u32 off = fst.resourceOff;
-				u32 roffset = fst.bufferStart;
-
-				for (u32 i = 0; i < fst.archives.size(); ++i) {
-
-					u32 fsoId = fst.archives[i];
-					FileSystemObject &parent = (*fst.fsos)[fsoId];
-					NARC &narc = *(NARC*)(*fst.ptrs)[parent.resource];
-					NArchive archive;
-
-					try {
-						convert(narc, &archive);
-
-						for (u32 j = 0; j < archive.size(); ++j) {
-
-							std::string name = archive.getTypeName(j);
-							u32 size = 0;
-							runArchiveFunction<GenericResourceSize>(archive.getType(j), ArchiveTypes(), &size);
-
-							archive.copyResource(j, fst.resources.data + roffset, size);
-							(*fst.ptrs)[off] = (GenericResourceBase*)(fst.resources.data + roffset);
-
-							FileSystemObject &fso = (*fst.fsos)[off + delta];
-
-							fso.index = off + delta;
-							fso.resource = off;
-							fso.buffer = { nullptr, 0 };
-							fso.name = std::to_string(j) + "." + name;
-							fso.parent = fsoId;
-							fso.path = parent.path + "/" + fso.name;
-							fso.indexInFolder = parent.count;
-							fso.fileHint = fso.folderHint = u32_MAX;
-							
-							if (parent.fileHint == u32_MAX)
-								parent.fileHint = fso.index;
-							
-							++parent.count;
-
-							u32 boff = getUInt(offset(narc.contents.front.data, j * 8));
-							u32 bsize = getUInt(offset(narc.contents.front.data, j * 8 + 4)) - boff;
-							u8 *bdata = narc.contents.back.back.front.data.data + boff;
-							fso.buffer = { bdata, bsize };
-
-							roffset += size;
-							++off;
-						}
-					}
-					catch (std::exception e) {}
-				}
-
-			}, thrs[thrI]));
-
-			archives.clear();
-			++thrI;
-			fileOff += fileC;
-			fileC = 0;
-		}
+	for (u32 j = start; j < end; ++j) {
+		u32 i = t.subtree[j];
+		if (!t.isFolder(i) || includeDirs)
+			filesInFolder.push_back(&files[i]);
 	}
 
-	for (u32 i = 0; i < threads; ++i)
-		if (processes[i].valid())
-			processes[i].get();
-		else
-			printf("Invalid future process at thread %u\n", i);
+	return filesInFolder;
+}
 
-	t.lap("Init sub resources");
+std::vector<FileSystemObject>::const_iterator FileSystem::begin() { return files.begin(); }
+std::vector<FileSystemObject>::const_iterator FileSystem::end() { return files.end(); }
+u32 FileSystem::getFileObjectCount() { return (u32)files.size(); }
+u32 FileSystem::getFileCount() { return fileC; }
+u32 FileSystem::getFolderCount() { return folderC; }
 
-	///Turn into file system
-	*fs = FileSystem(std::move(fso), std::move(resourcePtrs), resources, folderArraySize, (u32)fso.size() - folderArraySize);
+const FileSystemObject &FileSystem::operator[](u32 i) {
+	if (i >= files.size())
+		throw(std::exception("Out of bounds"));
+	return files[i];
+}
 
-	t.lap("Finalizing sub resources");
-	t.stop();
-	t.print();
 
-	return true;
+const FileSystemObject *FileSystem::getChild(const FileSystemObject &folder, u32 i) const {
+
+	u32 id = find(folder);
+	const FileTable &t = *table;
+
+	expand(folder);
+
+	u32 folders = t.folderOffsets[id + 1] - t.folderOffsets[id];
+
+	if (i < folders)
+		return &files[t.folderChildren[t.folderOffsets[id] + i]];
+
+	i -= folders;
+
+	if (i < t.fileOffsets[id + 1] - t.fileOffsets[id])
+		return &files[t.fileChildren[t.fileOffsets[id] + i]];
+
+	return nullptr;
+}
+
+u32 FileSystem::getChildIndex(const FileSystemObject &fso) const {
+	return table->indexInFolder[find(fso)];
+}
+
+FileSystemObject *FileSystem::foreachInFolder(bool(*f)(const FileSystemObject &fso, u32 i, u32 param), FileSystemObject &start, u32 param) {
+
+	u32 id = find(start);
+	const FileTable &t = *table;
+
+	expand(start);
+
+	u32 j = 0;
+	for (u32 k = t.folderOffsets[id]; k < t.folderOffsets[id + 1]; ++k, ++j)
+		if (f(files[t.folderChildren[k]], j, param))
+			return &files[t.folderChildren[k]];
+
+	for (u32 k = t.fileOffsets[id]; k < t.fileOffsets[id + 1]; ++k, ++j)
+		if (f(files[t.fileChildren[k]], j, param))
+			return &files[t.fileChildren[k]];
+
+	return nullptr;
+}
+
+template<class T> bool FileSystem::isFile(T t) {
+	try {
+		const FileSystemObject &obj = (*this)[t];
+		return obj.isFile();
+	}
+	catch (std::exception e) {
+		throw(std::exception(std::string("Couldn't get file (\"").append(e.what()).append("\")").c_str()));
+		return false;
+	}
+}
+
+template<class T> bool FileSystem::isFolder(T t) {
+	try {
+		const FileSystemObject &obj = (*this)[t];
+		return obj.isFolder();
+	}
+	catch (std::exception e) {
+		throw(std::exception(std::string("Couldn't get file (\"").append(e.what()).append("\")").c_str()));
+		return false;
+	}
+}
+
+template<class T> bool FileSystem::isRoot(T t) {
+	try {
+		const FileSystemObject &obj = (*this)[t];
+		return obj.isRoot();
+	}
+	catch (std::exception e) {
+		throw(std::exception(std::string("Couldn't get file (\"").append(e.what()).append("\")").c_str()));
+		return false;
+	}
+}
+
+//FileSystemObject
+
+bool FileSystemObject::isFolder() const { return table->isFolder(index); }
+bool FileSystemObject::isFile() const { return !isFolder(); }
+bool FileSystemObject::isRoot() const { return table->isRoot(index); }
+bool FileSystemObject::hasParent() const { return !isRoot(); }
+bool FileSystemObject::operator==(const FileSystemObject &other) const {
+	return table == other.table && index == other.index;
+}
+
+std::string FileSystemObject::getExtension() const { return table->getExtension(index); }
+
+bool FileSystemObject::getMagicNumber(std::string &name, u32 &number) const {
+
+	if (!isFile()) {
+		name = "";
+		number = 0;
+		return true;
+	}
+
+	name = table->getTypeName(index);
+	number = table->magicNumbers[index];
+	return table->validTypes[index] != 0;
+}
+
+std::string FileSystemObject::getPath() const { return table->getPath(index); }
+std::string FileSystemObject::getName() const { return table->getName(index); }
+u32 FileSystemObject::getParent() const { return table->parents[index]; }
+u32 FileSystemObject::getResource() const { return table->resources[index]; }
+Buffer FileSystemObject::getBuffer() const { return table->buffers[index]; }
+bool FileSystemObject::isCompressed() const { return table->compressed[index].data != nullptr; }
+Buffer FileSystemObject::getStoredBuffer() const { return isCompressed() ? table->compressed[index] : table->buffers[index]; }
+
+std::string FileSystemObject::getType() const { return table->getTypeName(index); }
+u32 FileSystemObject::getMagicNumber() const { return table->magicNumbers[index]; }
+u32 FileSystemObject::getTypeId() const { return table->typeIds[index]; }
+bool FileSystemObject::hasValidType() const { return table->validTypes[index] != 0; }
+
+u32 FileSystemObject::getFolders() const { return table->folderOffsets[index + 1] - table->folderOffsets[index]; }
+u32 FileSystemObject::getFiles() const { return table->fileOffsets[index + 1] - table->fileOffsets[index]; }
+u32 FileSystemObject::size() const { return getFolders() + getFiles(); }
+u32 FileSystemObject::getIndex() const { return table->indexInFolder[index]; }
+
+//A file or folder in the sub table of a folder
+//name is the offset of the name in the file name table, id is the folder id or the index of the file in the folder
+struct FileTableEntry {
+	u32 name, length, id;
+	bool isFolder;
+};
+
+//Reads the sub table of a folder, which starts at 'off' in the file name table and ends with a zero
+//files is set to the number of files in the folder
+static void readFolderTable(Buffer fileNames, u32 off, std::vector<FileTableEntry> &entries, u32 &files) {
+
+	files = 0;
+
+	while (true) {
+
+		if (off >= fileNames.size)
+			throw(std::exception("Invalid file name table; sub table is out of bounds"));
+
+		u8 len = fileNames.data[off];
+		++off;
+
+		if (len == 0)
+			break;
+
+		FileTableEntry entry = { off, (u32)(len & 0x7F), 0, (len & 0x80) != 0 };
+		off += entry.length;
+
+		if (entry.isFolder) {
+
+			if (off + 2 > fileNames.size)
+				throw(std::exception("Invalid file name table; sub table is out of bounds"));
+
+			entry.id = (fileNames.data[off] | (fileNames.data[off + 1] << 8)) & 0xFFF;
+			off += 2;
+		}
+		else
+			entry.id = files++;
+
+		if (off > fileNames.size)
+			throw(std::exception("Invalid file name table; sub table is out of bounds"));
+
+		entries.push_back(entry);
+	}
+}
+
+//Reads the folders and files from the file name and file allocation table
+//rom is the ROM's data starting at romOffset; when it is a null buffer, the file buffers are left empty and the ROM offsets are stored in 'offsets' instead
+//Every folder stores where its sub table starts and the id of its first file, so the folders are read in parallel and put into the table afterwards
+static bool readFileTable(Buffer fileNames, Buffer filePositions, Buffer rom, u32 romOffset, FileTable &table, u32 &folderArraySize, std::vector<u32> *offsets, ThreadPool &pool) {
+
+	if (fileNames.size < sizeof(FolderInfo)) {
+		throw(std::exception("Invalid buffer size"));
+		return false;
+	}
+
+	///Get root
+
+	FolderInfo *folderArray = (FolderInfo*)fileNames.data;
+	FolderInfo &root = folderArray[0];
+
+	if ((root.relation & 0xF000) != 0) {
+		throw(std::exception("Invalid file table; first folder isn't root"));
+		return false;
+	}
+
+	folderArraySize = root.relation;
+
+	if (fileNames.size < sizeof(FolderInfo) * folderArraySize) {
+		throw(std::exception("Out of bounds exception"));
+		return false;
+	}
+
+	///Read sub tables
+
+	std::vector<std::vector<FileTableEntry>> entries(folderArraySize);
+	std::vector<u32> firstFile(folderArraySize + 1, 0);
+
+	pool.parallelFor(folderArraySize, [&](u32 i, u32) {
+		readFolderTable(fileNames, folderArray[i].offset, entries[i], firstFile[i + 1]);
+	});
+
+	//The files of a folder are stored after the files of the folders before it
+
+	for (u32 i = 0; i < folderArraySize; ++i)
+		firstFile[i + 1] += firstFile[i];
+
+	u32 totalFiles = firstFile[folderArraySize];
+
+	///Get folder info
+
+	table.resize(folderArraySize + totalFiles);
+
+	for (u32 i = 0; i < folderArraySize; ++i) {
+		table.resources[i] = i == 0 ? u32_MAX - 1 : u32_MAX;
+		table.parents[i] = i == 0 ? u32_MAX : folderArray[i].relation & 0xFFF;
+		table.validTypes[i] = 1;
+	}
+
+	table.setName(0, "/");
+
+	for (u32 i = 0; i < folderArraySize; ++i)
+		for (FileTableEntry &entry : entries[i])
+			if (entry.isFolder) {
+
+				if (entry.id >= folderArraySize)
+					throw(std::exception("Invalid file name table; folder is out of bounds"));
+
+				table.setName(entry.id, std::string((char*)fileNames.data + entry.name, entry.length));
+			}
+
+	///Get file info
+	///The names are stored in a separate string per folder and moved into the table afterwards
+
+	if (offsets != nullptr)
+		offsets->resize(totalFiles);
+
+	std::vector<std::string> names(folderArraySize);
+
+	pool.parallelFor(folderArraySize, [&](u32 i, u32) {
+
+		for (FileTableEntry &entry : entries[i]) {
+
+			if (entry.isFolder)
+				continue;
+
+			u32 fileOffset = folderArray[i].firstFilePosition + entry.id;
+
+			if ((fileOffset + 1) * 8 > filePositions.size)
+				throw(std::exception("Invalid file allocation table; file is out of bounds"));
+
+			u32 &x = *(u32*)(filePositions.data + fileOffset * 8);
+			u32 &y = *(u32*)(filePositions.data + fileOffset * 8 + 4);
+			u32 len = y - x;
+
+			u32 resource = firstFile[i] + entry.id;
+			u32 file = folderArraySize + resource;
+
+			Buffer buffer = { nullptr, len };
+
+			if (rom.data != nullptr) {
+				buffer = offset(rom, x - romOffset);
+				buffer.size = len;
+			} else
+				(*offsets)[resource] = x;
+
+			table.parents[file] = i;
+			table.resources[file] = resource;
+			table.buffers[file] = buffer;
+
+			std::string name((char*)fileNames.data + entry.name, entry.length);
+			table.setName(file, name, names[i]);
+			table.detectType(file, getExtension(name));
+		}
+	});
+
+	for (u32 i = 0; i < folderArraySize; ++i)
+		table.moveNames(folderArraySize + firstFile[i], folderArraySize + firstFile[i + 1], names[i]);
+
+	return true;
+}
+
+//A NARC that is converted while reading the files, with the contents of its sub files and the reason they couldn't be read (see NType::convert)
+struct ConvertedArchive {
+	NArchive archive;
+	NArchiveFiles files;
+};
+
+//Fills in the sub files of a NARC from 'converted'; they are stored in the table from 'first' and in ptrs from 'firstResource'
+//The resources are copied to one allocation from 'memory', which is exactly as big as the resources of the NARC
+//The names are added to arena, or to the space that is reserved for them if arena is null
+//If named is true, the table already contains the sub files (see NType::readIndex) and only their resources are stored
+//Sub files that couldn't be read are added to diagnostics
+static void storeArchive(ConvertedArchive &converted, NARC &narc, FileTable &table, u32 narcIndex, u32 first, u32 firstResource, Arena &memory, GenericResourceBase **ptrs, std::string *arena, FileSystemDiagnostics &diagnostics, bool named = false) {
+
+	NArchive &archive = converted.archive;
+	NArchiveFiles &files = converted.files;
+
+	try {
+
+		std::vector<u32> sizes(archive.size());
+		u32 total = 0;
+
+		for (u32 j = 0; j < archive.size(); ++j) {
+			runArchiveFunction<NType::GenericResourceSize>(archive.getType(j), ArchiveTypes(), &sizes[j]);
+			total += sizes[j];
+		}
+
+		u8 *data = memory.alloc(total);
+		u32 roffset = 0;
+
+		for (u32 j = 0; j < archive.size(); ++j) {
+
+			std::string name = archive.getTypeName(j);
+			u32 size = sizes[j];
+
+			archive.copyResource(j, data + roffset, size);
+			ptrs[firstResource + j] = (GenericResourceBase*)(data + roffset);
+			roffset += size;
+
+			u32 fso = first + j;
+
+			u32 boff = getUInt(offset(narc.contents.front.data, j * 8));
+			u32 bsize = getUInt(offset(narc.contents.front.data, j * 8 + 4)) - boff;
+			u8 *bdata = narc.contents.back.back.front.data.data + boff;
+
+			Buffer contents = files.contents[j];
+
+			if (files.errors[j] != nullptr)
+				diagnostics.add(fso, getUInt(contents), files.errors[j]);
+
+			//The sub files of a compressed NARC aren't in the ROM, so an index can't store them
+			table.buffers[fso] = contents;
+			table.compressed[fso] = files.compressed[j] ? Buffer{ bdata, bsize } : Buffer{ nullptr, 0 };
+
+			if (named)
+				continue;
+
+			table.parents[fso] = narcIndex;
+			table.resources[fso] = firstResource + j;
+
+			std::string fileName = std::to_string(j) + "." + name;
+
+			if (arena != nullptr)
+				table.setName(fso, fileName, *arena);
+			else
+				table.fillName(fso, fileName);
+
+			table.detectType(fso, getExtension(fileName));
+		}
+	}
+	catch (std::exception e) {}
+}
+
+//Converts a NARC and fills in its sub files (see storeArchive); compressed sub files are decompressed into memory
+//'files' sub files are reserved for the NARC; it isn't expanded if it contains a different number of files
+static void expandArchive(NARC &narc, FileTable &table, u32 narcIndex, u32 first, u32 firstResource, u32 files, std::shared_ptr<Arena> memory, GenericResourceBase **ptrs, std::string *arena, FileSystemDiagnostics &diagnostics, bool named = false) {
+
+	ConvertedArchive converted;
+
+	try {
+		if (!NType::convert(narc, &converted.archive, converted.files, memory) || converted.archive.size() != files)
+			return;
+	}
+	catch (std::exception e) {
+		return;
+	}
+
+	storeArchive(converted, narc, table, narcIndex, first, firstResource, *memory, ptrs, arena, diagnostics, named);
+}
+
+//Checks if [first, first + files) in the table are exactly the sub files of NARC 'narcIndex' and use resources [firstResource, firstResource + files)
+//The ranges of an index could be wrong, so they are checked before a NARC is expanded into them
+static bool isArchiveRange(const FileTable &table, u32 narcIndex, u32 files, u32 first, u32 firstResource, u32 resources) {
+
+	if (files == 0 || table.fileOffsets[narcIndex + 1] - table.fileOffsets[narcIndex] != files)
+		return false;
+
+	if ((u64)first + files > table.size() || (u64)firstResource + files > resources)
+		return false;
+
+	//Children are sorted by index, so they are the range if the first and last one are
+	if (table.fileChildren[table.fileOffsets[narcIndex]] != first || table.fileChildren[table.fileOffsets[narcIndex + 1] - 1] != first + files - 1)
+		return false;
+
+	for (u32 j = 0; j < files; ++j)
+		if (table.resources[first + j] != firstResource + j)
+			return false;
+
+	return true;
+}
+
+//Replaces the buffers of compressed resources by their decompressed contents in memory and detects their type again (see NType::decompressResource)
+static void decompressFiles(FileTable &table, u32 first, u32 files, Arena &memory, ThreadPool &pool) {
+
+	pool.parallelFor(files, [&](u32 j, u32) {
+
+		u32 i = j + first;
+		Buffer buffer = table.buffers[i];
+		Buffer contents = NType::decompressResource(buffer, memory);
+
+		if (contents.data == buffer.data)
+			return;
+
+		table.compressed[i] = buffer;
+		table.buffers[i] = contents;
+		table.detectType(i);
+	});
+}
+
+//Reads the resources of 'files' files, starting at 'first' in the table, into a new buffer
+//The size of every resource is known from its type, so every file gets its own place in the buffer and the files are read in parallel
+//isNarc is set for every NARC; if 'converted' isn't null, a NARC is also converted into it as soon as it is read
+//Files that can't be read as their type are stored as an NBUO and added to diagnostics
+//Compressed sub files of the converted NARCs are decompressed into memory
+static Buffer readResources(const FileTable &table, u32 first, u32 files, std::vector<GenericResourceBase*> &resourcePtrs, std::vector<u8> &isNarc, std::vector<std::unique_ptr<ConvertedArchive>> *converted, std::shared_ptr<Arena> memory, FileSystemDiagnostics &diagnostics, ThreadPool &pool) {
+
+	std::vector<u32> resourceOffsets(files + 1, 0);
+
+	for (u32 j = 0; j < files; ++j) {
+
+		u32 i = j + first;
+		u32 mlen = 0;
+		runArchiveFunction<NType::GenericResourceSize>(table.validTypes[i] ? table.magicNumbers[i] : 0, ArchiveTypes(), &mlen);
+
+		resourceOffsets[j + 1] = resourceOffsets[j] + mlen;
+	}
+
+	Buffer resources = newBuffer1(resourceOffsets[files]);
+	resourcePtrs.assign(files, nullptr);
+	isNarc.assign(files, 0);
+
+	if (converted != nullptr)
+		converted->resize(files);
+
+	pool.parallelFor(files, [&](u32 j, u32) {
+
+		u32 i = j + first;
+		u32 magicNumber = table.validTypes[i] ? table.magicNumbers[i] : 0;
+
+		u8 *at = resources.data + resourceOffsets[j];
+		u32 mlen = resourceOffsets[j + 1] - resourceOffsets[j];
+
+		resourcePtrs[j] = (GenericResourceBase*)at;
+
+		const char *error = nullptr;
+		runArchiveFunction<NType::TryNFactory>(magicNumber, ArchiveTypes(), (void*)at, table.buffers[i], &error);
+
+		if (error != nullptr) {
+
+			diagnostics.add(i, magicNumber, error);
+
+			if (mlen >= sizeof(NBUO)) {
+				runArchiveFunction<NType::NFactory>(0, ArchiveTypes(), (void*)at, table.buffers[i]);
+			}
+			else
+				memset(at, 0, mlen);
+
+			return;
+		}
+
+		if (magicNumber != MagicNumber::get<NARC>)
+			return;
+
+		isNarc[j] = 1;
+
+		if (converted == nullptr)
+			return;
+
+		std::unique_ptr<ConvertedArchive> &archive = (*converted)[j];
+		archive = std::unique_ptr<ConvertedArchive>(new ConvertedArchive());
+
+		try {
+			if (!NType::convert(*(NARC*)at, &archive->archive, archive->files, memory))
+				archive.reset();
+		}
+		catch (std::exception e) {
+			archive.reset();
+		}
+	});
+
+	return resources;
+}
+
+//Reserves the sub files of every NARC at the end of the table and resources; NARC i is file narcs[i] and contains files[i] sub files
+//If the NARCs are expanded later, the names of the sub files are reserved too (see FileSystemArchives)
+//'names' of the table doesn't grow after this, so a NARC that is expanded on another thread only writes into its reserved space (see FileTable::fillName)
+static std::shared_ptr<FileSystemArchives> reserveArchives(FileTable &table, u32 folders, const std::vector<u32> &narcs, const std::vector<u32> &files, std::vector<GenericResourceBase*> &resourcePtrs, bool reserveNames) {
+
+	u32 subfiles = 0;
+
+	for (u32 count : files)
+		subfiles += count;
+
+	std::shared_ptr<FileSystemArchives> arcs = std::make_shared<FileSystemArchives>((u32)narcs.size());
+	arcs->start = table.size();
+
+	table.resize(table.size() + subfiles);
+	resourcePtrs.resize(resourcePtrs.size() + subfiles, nullptr);
+
+	u32 next = arcs->start;
+
+	for (u32 i = 0; i < narcs.size(); ++i) {
+
+		u32 fsoId = narcs[i] + folders;
+
+		arcs->archives[i] = fsoId;
+		arcs->firstChild[i] = next;
+		arcs->firstResource[i] = next - folders;
+		arcs->byIndex[fsoId] = i;
+
+		for (u32 j = 0; j < files[i]; ++j) {
+
+			table.parents[next + j] = fsoId;
+			table.resources[next + j] = next + j - folders;
+
+			if (reserveNames)
+				table.reserveName(next + j, (u32)std::to_string(j).size() + 5);
+		}
+
+		next += files[i];
+	}
+
+	return arcs;
+}
+
+bool NType::convert(NDS nds, FileSystem *fs, FileSystemSettings settings) {
+
+	if (!settings.indexPath.empty()) {
+
+		//An index that can't be read is written again
+
+		try {
+			if (readIndex(nds, fs, settings.indexPath))
+				return true;
+		}
+		catch (std::exception e) {}
+
+		std::string indexPath = settings.indexPath;
+		settings.indexPath = "";
+
+		if (!convert(nds, fs, settings))
+			return false;
+
+		writeIndex(nds, *fs, indexPath);
+		return true;
+	}
+
+	oi::Timer t;
+
+	///Find file alloc and name table
+
+	Buffer fileNames = offset(nds.data, nds.ftable_off - nds.romHeaderSize);
+	fileNames.size = nds.ftable_len;
+
+	Buffer filePositions = offset(nds.data, nds.falloc_off - nds.romHeaderSize);
+	filePositions.size = nds.falloc_len;
+
+	///Get folder and file info
+
+	std::shared_ptr<FileTable> table = std::make_shared<FileTable>();
+	u32 folderArraySize = 0;
+
+	ThreadPool pool(settings.threads);
+
+	if (!readFileTable(fileNames, filePositions, nds.data, nds.romHeaderSize, *table, folderArraySize, nullptr, pool))
+		return false;
+
+	t.lap("File info");
+	///Get file resources
+
+	u32 totalFiles = table->size() - folderArraySize;
+	std::vector<GenericResourceBase*> resourcePtrs;
+	std::vector<u8> isNarc;
+
+	//Decompressed files and the resources of sub files are allocated from an arena, so the resources of the other files don't have to move
+	std::shared_ptr<Arena> memory = std::make_shared<Arena>();
+
+	decompressFiles(*table, folderArraySize, totalFiles, *memory, pool);
+
+	//A NARC is converted as soon as it is read, instead of waiting for the other files
+	//Its sub files are put into the table once every NARC is known
+	std::vector<std::unique_ptr<ConvertedArchive>> converted;
+	std::shared_ptr<FileSystemDiagnostics> diagnostics = std::make_shared<FileSystemDiagnostics>();
+
+	Buffer resources = readResources(*table, folderArraySize, totalFiles, resourcePtrs, isNarc, settings.lazyArchives ? nullptr : &converted, memory, *diagnostics, pool);
+
+	std::vector<u32> narcs, narcFiles;
+
+	for (u32 j = 0; j < totalFiles; ++j)
+		if (isNarc[j]) {
+			narcs.push_back(j);
+			narcFiles.push_back(((NARC*)resourcePtrs[j])->contents.front.files);
+		}
+
+	t.lap("Resources");
+	///Get sub resources (inside archive)
+
+		///Reserve sub files; every NARC gets a range in the table and resources
+
+	std::shared_ptr<FileSystemArchives> arcs = reserveArchives(*table, folderArraySize, narcs, narcFiles, resourcePtrs, settings.lazyArchives);
+
+	if (settings.lazyArchives) {
+
+		t.lap("Reserve sub files");
+
+		*fs = FileSystem(table, resourcePtrs, resources, folderArraySize, table->size() - folderArraySize, nullptr, arcs, memory, diagnostics);
+
+		t.lap("Finalizing sub resources");
+		t.stop();
+		t.print();
+
+		return true;
+	}
+
+		///Init sub resources
+
+	//Every NARC is a task; its range in the table and resource pointers is reserved already, so the tasks don't have to lock anything
+	//The NARCs were converted while reading the files, so this only copies their sub files
+	//The names are stored in a separate string per NARC and moved into the table afterwards
+
+	std::vector<std::string> names(narcs.size());
+	std::vector<u32> order(narcs.size());
+
+	for (u32 i = 0; i < order.size(); ++i)
+		order[i] = i;
+
+	//Start with the biggest NARCs, so a big NARC isn't the last thing that is left
+
+	std::stable_sort(order.begin(), order.end(), [&](u32 a, u32 b) -> bool { return narcFiles[a] > narcFiles[b]; });
+
+	pool.parallelFor((u32)order.size(), [&](u32 i, u32) {
+
+		u32 a = order[i];
+		u32 fsoId = arcs->archives[a];
+		u32 firstResource = arcs->firstResource[a];
+
+		ConvertedArchive *archive = converted[narcs[a]].get();
+
+		if (archive == nullptr)
+			return;
+
+		NARC &narc = *(NARC*)resourcePtrs[table->resources[fsoId]];
+		storeArchive(*archive, narc, *table, fsoId, arcs->firstChild[a], firstResource, *memory, resourcePtrs.data(), &names[a], *diagnostics);
+		converted[narcs[a]].reset();
+	});
+
+	for (u32 a = 0; a < narcs.size(); ++a)
+		table->moveNames(arcs->firstChild[a], arcs->firstChild[a] + narcFiles[a], names[a]);
+
+	t.lap("Init sub resources");
+
+	///Turn into file system
+	*fs = FileSystem(table, resourcePtrs, resources, folderArraySize, table->size() - folderArraySize, nullptr, nullptr, memory, diagnostics);
+
+	t.lap("Finalizing sub resources");
+	t.stop();
+	t.print();
+
+	return true;
+}
+
+//Reserves the resources of 'files' files, starting at 'first' in the table, for a file system that is read lazily (see FileSystem::load)
+//Every slot is as big as the type in the table; a file that turns out to be bigger gets a slot from memory instead
+//A cleared slot is an empty NBUO
+static Buffer reserveResources(const FileTable &table, u32 first, u32 files, FileSystemSource &source, std::vector<GenericResourceBase*> &resourcePtrs) {
+
+	source.sizes.resize(files);
+	source.loaded.resize(files, { nullptr, 0 });
+
+	std::vector<u32> resourceOffsets(files + 1, 0);
+
+	for (u32 j = 0; j < files; ++j) {
+
+		u32 i = j + first;
+		u32 mlen = 0;
+		runArchiveFunction<NType::GenericResourceSize>(table.validTypes[i] ? table.magicNumbers[i] : 0, ArchiveTypes(), &mlen);
+
+		source.sizes[j] = mlen < sizeof(NBUO) ? (u32)sizeof(NBUO) : mlen;
+		resourceOffsets[j + 1] = resourceOffsets[j] + source.sizes[j];
+	}
+
+	Buffer resources = newBuffer1(resourceOffsets[files]);
+	resourcePtrs.resize(files);
+
+	for (u32 j = 0; j < files; ++j)
+		resourcePtrs[j] = (GenericResourceBase*)(resources.data + resourceOffsets[j]);
+
+	return resources;
+}
+
+//Reads the number of files of NARC 'resource' from its header; 0 if it isn't a NARC
+//Only the header of a NARC is read, but a compressed NARC is read completely and kept in 'loaded', so it doesn't have to be read again
+static u32 readArchiveFiles(FileSystemSource &src, u32 resource, u32 size) {
+
+	const u32 headerSize = (u32)sizeof(GenericHeader) + SectionLength::get<BTAF>;
+	u8 header[headerSize];
+
+	if (size < headerSize || !src.reader->read(src.offsets[resource], headerSize, header))
+		return 0;
+
+	u32 fileSize = size;
+
+	if (getUInt({ header, headerSize }) != MagicNumber::get<NARC>) {
+
+		//The compressed size can't be checked against the decompressed size without all of the data
+
+		Buffer &loaded = src.loaded[resource];
+
+		if (header[0] != COMPRESSION_LZ10 && header[0] != COMPRESSION_LZ11 && header[0] != COMPRESSION_HUFFMAN4 && header[0] != COMPRESSION_HUFFMAN8 && header[0] != COMPRESSION_RLE)
+			return 0;
+
+		if (loaded.data == nullptr)
+			loaded = src.read(resource, size);
+
+		fileSize = getDecompressedSize(loaded);
+
+		if (fileSize < headerSize || !decompress(loaded, { header, headerSize }))
+			return 0;
+	}
+
+	//The file table of the NARC has to fit in the file, so a broken header can't reserve a lot of sub files
+
+	Buffer buf = { header, headerSize };
+	u32 btaf = (u32)sizeof(GenericHeader);
+	u32 btafSize = getUInt(offset(buf, btaf + 4)), files = getUInt(offset(buf, btaf + 8));
+
+	if (getUInt(buf) != MagicNumber::get<NARC> || getUInt(offset(buf, btaf)) != MagicNumber::get<BTAF> || btafSize > fileSize - btaf || (u64)files * 8 + SectionLength::get<BTAF> != btafSize)
+		return 0;
+
+	return files;
+}
+
+bool NType::openNDS(std::string path, NDS *nds, FileSystem *fs, FileSystemSettings settings) {
+
+	oi::Timer t;
+
+	std::shared_ptr<FileSystemSource> source = std::make_shared<FileSystemSource>(path);
+	RomReader &reader = *source->reader;
+
+	if (!reader.isOpen()) {
+		throw(std::exception("Couldn't open ROM"));
+		return false;
+	}
+
+	///Read header
+
+	Buffer header = reader.read(0, (u32)(sizeof(NDS) - GenericSection_begin));
+
+	if (header.data == nullptr) {
+		throw(std::exception("Couldn't read NDS; invalid file size"));
+		return false;
+	}
+
+	*nds = readNDS(header);
+	nds->data = { nullptr, 0 };
+	deleteBuffer(&header);
+
+	///Read file alloc and name table
+
+	Buffer fileNames = reader.read(nds->ftable_off, nds->ftable_len);
+	Buffer filePositions = reader.read(nds->falloc_off, nds->falloc_len);
+
+	if (fileNames.data == nullptr || filePositions.data == nullptr) {
+		deleteBuffer(&fileNames);
+		deleteBuffer(&filePositions);
+		throw(std::exception("Couldn't read file name or file allocation table"));
+		return false;
+	}
+
+	t.lap("Read tables");
+
+	///Get folder and file info
+
+	std::shared_ptr<FileTable> table = std::make_shared<FileTable>();
+	u32 folderArraySize = 0;
+	bool read = false;
+
+	try {
+		ThreadPool pool(settings.threads);
+		read = readFileTable(fileNames, filePositions, { nullptr, 0 }, 0, *table, folderArraySize, &source->offsets, pool);
+	} catch (std::exception e) {
+		deleteBuffer(&fileNames);
+		deleteBuffer(&filePositions);
+		throw;
+	}
+
+	deleteBuffer(&fileNames);
+	deleteBuffer(&filePositions);
+
+	if (!read)
+		return false;
+
+	t.lap("File info");
+
+	///Reserve resources; they are filled in by FileSystem::load
+
+	u32 totalFiles = table->size() - folderArraySize;
+
+	std::vector<GenericResourceBase*> resourcePtrs;
+	Buffer resources = reserveResources(*table, folderArraySize, totalFiles, *source, resourcePtrs);
+
+	t.lap("Reserve resources");
+
+	///Reserve sub files; only the header of every NARC is read, the NARC is expanded once it is used (see FileSystemArchives)
+
+	std::vector<u32> narcs, narcFiles;
+
+	for (u32 j = 0; j < totalFiles; ++j) {
+
+		u32 i = j + folderArraySize;
+
+		if (!table->validTypes[i] || table->magicNumbers[i] != MagicNumber::get<NARC>)
+			continue;
+
+		u32 files = readArchiveFiles(*source, j, table->buffers[i].size);
+
+		if (files != 0) {
+			narcs.push_back(j);
+			narcFiles.push_back(files);
+		}
+	}
+
+	std::shared_ptr<FileSystemArchives> arcs = reserveArchives(*table, folderArraySize, narcs, narcFiles, resourcePtrs, true);
+
+	*fs = FileSystem(table, resourcePtrs, resources, folderArraySize, table->size() - folderArraySize, source, arcs);
+
+	t.lap("Reserve sub files");
+	t.stop();
+	t.print();
+
+	return true;
+}
+
+//Index
+
+//Header of an index file (see NType::writeIndex); followed by the table's arrays, names, type names and NARCs
+struct FileSystemIndexHeader {
+	u32 magicNumber, version;
+	u32 romSize, romHeaderSize;
+	u64 romHash;
+	u32 typeHash;
+	u16 headerChecksum, padding;
+	u32 objects, folders, archives;
+	u32 namesSize, typeNames;
+};
+
+static const u32 indexMagicNumber = 0x4953464E;		//NFSI
+static const u32 indexVersion = 3;
+
+//Hashes the magic number and size of every resource type, so an index isn't used by a library with other types
+template<typename T>
+struct IndexTypeHash {
+	void operator()(u32 *result) {
+		u32 type[2] = { MagicNumber::get<T>, (u32)sizeof(T) };
+		*result = FileTable::hash((const char*)type, sizeof(type), *result);
+	}
+};
+
+//Continues an FNV-1a hash with the bytes of 'data'; 8 bytes are hashed at a time
+static u64 hashBytes(u64 h, Buffer data) {
+
+	const u64 prime = 1099511628211ULL;
+	u32 j = 0;
+
+	for (; j + 8 <= data.size; j += 8) {
+		u64 word;
+		memcpy(&word, data.data + j, 8);
+		h = (h ^ word) * prime;
+		h ^= h >> 32;
+	}
+
+	for (; j < data.size; ++j)
+		h = (h ^ data.data[j]) * prime;
+
+	return h;
+}
+
+//Hashes the file name and allocation table and samples of the ROM's contents
+//Hashing all of a big ROM takes about as long as converting it, so only 64 blocks of 4 KiB are hashed; the header checksum covers the header
+//Files that change without moving can still match, but their contents and types are read from the ROM when they are loaded anyway
+static u64 hashRom(NDS nds) {
+
+	const u32 samples = 64, sample = 0x1000;
+	Buffer data = nds.data;
+
+	u64 h = 14695981039346656037ULL ^ data.size;
+
+	Buffer fileNames = offset(data, nds.ftable_off - nds.romHeaderSize);
+	fileNames.size = fileNames.size < nds.ftable_len ? fileNames.size : nds.ftable_len;
+
+	Buffer filePositions = offset(data, nds.falloc_off - nds.romHeaderSize);
+	filePositions.size = filePositions.size < nds.falloc_len ? filePositions.size : nds.falloc_len;
+
+	h = hashBytes(h, fileNames);
+	h = hashBytes(h, filePositions);
+
+	if (data.size <= samples * sample)
+		return hashBytes(h, data);
+
+	for (u32 i = 0; i < samples; ++i)
+		h = hashBytes(h, { data.data + (u64)(data.size - sample) * i / (samples - 1), sample });
+
+	return h;
+}
+
+static FileSystemIndexHeader makeIndexHeader(NDS nds) {
+
+	FileSystemIndexHeader header;
+	memset(&header, 0, sizeof(header));
+
+	header.magicNumber = indexMagicNumber;
+	header.version = indexVersion;
+	header.romSize = nds.data.size;
+	header.romHeaderSize = nds.romHeaderSize;
+	header.headerChecksum = nds.nHC;
+
+	header.typeHash = FileTable::hash(nullptr, 0);
+	lag::RunForType<IndexTypeHash>::run(ArchiveTypes(), &header.typeHash);
+
+	header.romHash = hashRom(nds);
+	return header;
+}
+
+template<typename T>
+static void writeIndexArray(std::vector<u8> &out, const T *arr, u32 count) {
+	const u8 *begin = (const u8*)arr;
+	out.insert(out.end(), begin, begin + count * sizeof(T));
+}
+
+template<typename T>
+static void readIndexArray(Buffer &in, T *arr, u32 count) {
+
+	if (in.size < count * sizeof(T))
+		throw(std::exception("Invalid index; out of bounds"));
+
+	memcpy(arr, in.data, count * sizeof(T));
+	in = offset(in, count * sizeof(T));
+}
+
+bool NType::writeIndex(NDS nds, const FileSystem &fs, std::string path) {
+
+	if (fs.isLazy())
+		return false;
+
+	//Names of sub files are only known once their NARC is expanded
+	fs.expandAll();
+
+	const FileTable &table = *fs.table;
+	u32 n = table.size();
+
+	///Find the NARCs; they are the files that have children
+
+	std::vector<u32> archives, firstChild, firstResource;
+	u32 start = n;
+
+	for (u32 i = fs.folderC; i < n; ++i)
+		if (table.fileOffsets[i + 1] != table.fileOffsets[i]) {
+
+			u32 child = table.fileChildren[table.fileOffsets[i]];
+
+			archives.push_back(i);
+			firstChild.push_back(child);
+			firstResource.push_back(table.resources[child]);
+
+			if (child < start)
+				start = child;
+		}
+
+	///Store the buffers relative to the ROM; compressed files are decompressed again when the index is read
+
+	std::vector<u32> bufferOffsets(n), bufferSizes(n);
+
+	for (u32 i = 0; i < n; ++i) {
+
+		Buffer buffer = table.compressed[i].data != nullptr ? table.compressed[i] : table.buffers[i];
+		bool inRom = buffer.data >= nds.data.data && buffer.data + buffer.size <= nds.data.data + nds.data.size;
+
+		bufferOffsets[i] = buffer.data != nullptr && inRom ? (u32)(buffer.data - nds.data.data) : u32_MAX;
+		bufferSizes[i] = buffer.size;
+	}
+
+	///Write index
+
+	FileSystemIndexHeader header = makeIndexHeader(nds);
+
+	header.objects = n;
+	header.folders = fs.folderC;
+	header.archives = (u32)archives.size();
+	header.namesSize = (u32)table.names.size();
+	header.typeNames = (u32)table.typeNames.size();
+
+	std::vector<u8> out;
+	writeIndexArray(out, &header, 1);
+
+	writeIndexArray(out, table.parents.data(), n);
+	writeIndexArray(out, table.resources.data(), n);
+	writeIndexArray(out, bufferOffsets.data(), n);
+	writeIndexArray(out, bufferSizes.data(), n);
+	writeIndexArray(out, table.nameOffsets.data(), n);
+	writeIndexArray(out, table.nameLengths.data(), n);
+	writeIndexArray(out, table.pathHashes.data(), n);
+	writeIndexArray(out, table.types.data(), n);
+	writeIndexArray(out, table.magicNumbers.data(), n);
+	writeIndexArray(out, table.typeIds.data(), n);
+	writeIndexArray(out, table.validTypes.data(), n);
+	writeIndexArray(out, table.names.data(), header.namesSize);
+
+	for (const std::string &name : table.typeNames) {
+		u32 length = (u32)name.size();
+		writeIndexArray(out, &length, 1);
+		writeIndexArray(out, name.c_str(), length);
+	}
+
+	writeIndexArray(out, &start, 1);
+	writeIndexArray(out, archives.data(), header.archives);
+	writeIndexArray(out, firstChild.data(), header.archives);
+	writeIndexArray(out, firstResource.data(), header.archives);
+
+	return writeBuffer({ out.data(), (u32)out.size() }, path);
+}
+
+bool NType::readIndex(NDS nds, FileSystem *fs, std::string path) {
+
+	oi::Timer t;
+
+	Buffer file = mapFile(path, FM_READ_ONLY);
+
+	if (file.data == nullptr)
+		return false;
+
+	Buffer in = file;
+	FileSystemIndexHeader header;
+
+	std::shared_ptr<FileTable> table = std::make_shared<FileTable>();
+	std::shared_ptr<FileSystemArchives> arcs;
+
+	//Files are read from the ROM in memory when they are used
+	std::shared_ptr<FileSystemSource> source = std::make_shared<FileSystemSource>(nds.data);
+
+	try {
+
+		///Check if the index belongs to this ROM; the ROM is only hashed if everything else matches
+
+		readIndexArray(in, &header, 1);
+
+		if (header.magicNumber != indexMagicNumber || header.version != indexVersion || header.romSize != nds.data.size || header.romHeaderSize != nds.romHeaderSize || header.headerChecksum != nds.nHC) {
+			unmapFile(&file);
+			return false;
+		}
+
+		FileSystemIndexHeader expected = makeIndexHeader(nds);
+
+		if (header.typeHash != expected.typeHash || header.romHash != expected.romHash) {
+			unmapFile(&file);
+			return false;
+		}
+
+		t.lap("Check index");
+
+		///Read table
+
+		u32 n = header.objects;
+
+		if (header.folders > n)
+			throw(std::exception("Invalid index; folders are out of bounds"));
+
+		table->resize(n);
+
+		std::vector<u32> bufferOffsets(n), bufferSizes(n);
+
+		readIndexArray(in, table->parents.data(), n);
+		readIndexArray(in, table->resources.data(), n);
+		readIndexArray(in, bufferOffsets.data(), n);
+		readIndexArray(in, bufferSizes.data(), n);
+		readIndexArray(in, table->nameOffsets.data(), n);
+		readIndexArray(in, table->nameLengths.data(), n);
+		readIndexArray(in, table->pathHashes.data(), n);
+		readIndexArray(in, table->types.data(), n);
+		readIndexArray(in, table->magicNumbers.data(), n);
+		readIndexArray(in, table->typeIds.data(), n);
+		readIndexArray(in, table->validTypes.data(), n);
+
+		table->names.resize(header.namesSize);
+		readIndexArray(in, table->names.data(), header.namesSize);
+
+		table->typeNames.clear();
+		table->typeNameIds.clear();
+
+		for (u32 i = 0; i < header.typeNames; ++i) {
+
+			u32 length = 0;
+			readIndexArray(in, &length, 1);
+
+			std::string name(length, '\0');
+			readIndexArray(in, &name[0], length);
+
+			table->typeNameIds[name] = i;
+			table->typeNames.push_back(name);
+		}
+
+		for (u32 i = 0; i < n; ++i) {
+
+			if (table->nameOffsets[i] + table->nameLengths[i] > header.namesSize || table->types[i] >= header.typeNames)
+				throw(std::exception("Invalid index; name or type is out of bounds"));
+
+			if (bufferOffsets[i] != u32_MAX && (u64)bufferOffsets[i] + bufferSizes[i] > nds.data.size)
+				throw(std::exception("Invalid index; buffer is out of bounds"));
+
+			//Folders come first and point to a folder or the root (u32_MAX); files point to an object before them
+
+			u32 parent = table->parents[i];
+
+			if (parent != u32_MAX && (i < header.folders ? parent >= header.folders : parent >= i))
+				throw(std::exception("Invalid index; parent is out of bounds"));
+
+			if (i < header.folders ? !table->isFolder(i) : table->resources[i] >= n - header.folders)
+				throw(std::exception("Invalid index; resource is out of bounds"));
+
+			//Only the size is known until the file is loaded (see FileSystem::load) or its NARC is expanded
+			table->buffers[i] = { nullptr, bufferSizes[i] };
+		}
+
+		//Folders can point to any folder, so every chain of parents has to end at the root; otherwise getPath wouldn't end
+		//1 = being followed, 2 = ends at the root
+
+		std::vector<u8> state(header.folders);
+
+		for (u32 i = 0; i < header.folders; ++i) {
+
+			u32 j = i;
+
+			for (; j != u32_MAX && state[j] == 0; j = table->parents[j])
+				state[j] = 1;
+
+			if (j != u32_MAX && state[j] == 1)
+				throw(std::exception("Invalid index; folders contain a cycle"));
+
+			for (j = i; j != u32_MAX && state[j] == 1; j = table->parents[j])
+				state[j] = 2;
+		}
+
+		///Read NARCs
+
+		u32 start = 0;
+		readIndexArray(in, &start, 1);
+
+		if (start < header.folders || start > n)
+			throw(std::exception("Invalid index; sub files are out of bounds"));
+
+		arcs = std::make_shared<FileSystemArchives>(header.archives);
+		arcs->start = start;
+		arcs->named = true;
+
+		readIndexArray(in, arcs->archives.data(), header.archives);
+		readIndexArray(in, arcs->firstChild.data(), header.archives);
+		readIndexArray(in, arcs->firstResource.data(), header.archives);
+
+		for (u32 i = 0; i < header.archives; ++i) {
+
+			if (arcs->archives[i] < header.folders || arcs->archives[i] >= start || arcs->firstChild[i] < start || arcs->firstChild[i] >= n || arcs->firstResource[i] >= n - header.folders)
+				throw(std::exception("Invalid index; NARC is out of bounds"));
+
+			arcs->byIndex[arcs->archives[i]] = i;
+		}
+
+		///Top level files are read from the ROM
+
+		source->offsets.resize(start - header.folders);
+
+		for (u32 i = header.folders; i < start; ++i) {
+
+			if (bufferOffsets[i] == u32_MAX || table->resources[i] != i - header.folders)
+				throw(std::exception("Invalid index; file isn't in the ROM"));
+
+			source->offsets[i - header.folders] = bufferOffsets[i];
+		}
+	}
+	catch (std::exception e) {
+		unmapFile(&file);
+		throw;
+	}
+
+	unmapFile(&file);
+
+	t.lap("Read index");
+
+	///Reserve the top level resources; they are read when they are used, like a ROM that is opened lazily (see NType::openNDS)
+	///The sub files of NARCs are read when the NARC is expanded
+
+	std::vector<GenericResourceBase*> resourcePtrs;
+	Buffer resources = reserveResources(*table, header.folders, arcs->start - header.folders, *source, resourcePtrs);
+
+	resourcePtrs.resize(header.objects - header.folders, nullptr);
+
+	t.lap("Reserve resources");
+
+	*fs = FileSystem(table, resourcePtrs, resources, header.folders, header.objects - header.folders, source, arcs);
+
+	t.lap("Finalizing");
+	t.stop();
+	t.print();
+
+	return true;
+}
+
+bool FileSystem::load(const FileSystemObject &fso) const {
+
+	if (fso.table != table.get() || !fso.isFile())
+		return true;
+
+	//Sub files of a NARC only have contents once the NARC is expanded; they are read from the NARC instead of the source
+	if (archives != nullptr && fso.index >= archives->start && fso.index < files.size()) {
+		expand(files[fso.getParent()]);
+		return true;
+	}
+
+	if (source == nullptr)
+		return true;
+
+	FileSystemSource &src = *source;
+	std::lock_guard<std::mutex> lock(src.mutex);
+
+	u32 i = fso.index;
+
+	if (i >= files.size() || table->resources[i] >= src.offsets.size())
+		return false;
+
+	u32 resource = table->resources[i];
+
+	//The table is only modified while the source is locked, so the loaded buffer can be stored in it
+	Buffer &buffer = table->buffers[i];
+
+	//A copy of this file system could have loaded the file
+	if (buffer.data != nullptr || buffer.size == 0) {
+		updateResources(resource, 1);
+		return true;
+	}
+
+	Buffer &loaded = src.loaded[resource];
+
+	if (loaded.data == nullptr) {
+
+		loaded = src.read(resource, buffer.size);
+
+		if (loaded.data == nullptr)
+			return false;
+	}
+
+	Buffer contents = NType::decompressResource(loaded, *memory);
+
+	buffer = contents;
+
+	if (contents.data != loaded.data)
+		table->compressed[i] = loaded;
+
+	//The type was guessed from the extension until now
+	table->detectType(i);
+	u32 magicNumber = table->validTypes[i] ? table->magicNumbers[i] : 0;
+
+	//The slot was reserved for the type of the extension; a bigger resource is stored in memory instead
+
+	u32 mlen = 0;
+	runArchiveFunction<NType::GenericResourceSize>(magicNumber, ArchiveTypes(), &mlen);
+
+	void *at = resources[resource];
+
+	if (mlen > src.sizes[resource])
+		at = stored->ptrs[resource] = (GenericResourceBase*)memory->alloc(mlen);
+
+	const char *error = nullptr;
+	runArchiveFunction<NType::TryNFactory>(magicNumber, ArchiveTypes(), at, contents, &error);
+
+	if (error != nullptr) {
+		diagnostics->add(i, magicNumber, error);
+		runArchiveFunction<NType::NFactory>(0, ArchiveTypes(), at, contents);
+	}
+
+	updateResources(resource, 1);
+	return true;
+}
+
+Buffer FileSystem::getBuffer(const FileSystemObject &fso) const {
+
+	if (!load(fso))
+		throw(std::exception("Couldn't read file"));
+
+	return table->buffers[find(fso)];
+}
+
+bool FileSystem::isLazy() const { return source != nullptr; }
+
+const PaletteLUT &FileSystem::getPalette(const FileSystemObject &fso) const {
+
+	u32 i = find(fso);
+
+	{
+		std::lock_guard<std::mutex> lock(palettes->mutex);
+		auto it = palettes->byFile.find(i);
+
+		if (it != palettes->byFile.end())
+			return it->second;
+	}
+
+	//Converted without holding the lock; when two threads convert the same palette, the first one is kept
+
+	Texture2D tex;
+	NType::convert(getResource<NCLR>(fso), &tex);
+	PaletteLUT palette = convertPalette(tex);
+
+	std::lock_guard<std::mutex> lock(palettes->mutex);
+	return palettes->byFile.emplace(i, std::move(palette)).first->second;
+}
+
+std::vector<FileSystemDiagnostic> FileSystem::getDiagnostics() const {
+
+	std::vector<FileSystemDiagnostic> result;
+
+	{
+		std::lock_guard<std::mutex> lock(diagnostics->mutex);
+		result = diagnostics->list;
+	}
+
+	std::stable_sort(result.begin(), result.end(), [](const FileSystemDiagnostic &a, const FileSystemDiagnostic &b) -> bool { return a.file < b.file; });
+	return result;
+}
+
+void FileSystem::printDiagnostics() const {
+
+	for (const FileSystemDiagnostic &d : getDiagnostics())
+		printf("Couldn't read %s as %s; %s\n", table->getPath(d.file).c_str(), table->getTypeName(d.file).c_str(), d.reason);
+}
+
+bool FileSystem::expand(const FileSystemObject &fso) const {
+
+	if (archives == nullptr)
+		return false;
+
+	u32 id = find(fso);
+
+	auto it = archives->byIndex.find(id);
+
+	if (it == archives->byIndex.end())
+		return false;
+
+	u32 a = it->second;
+	FileSystemArchives &arcs = *archives;
+
+	std::call_once(arcs.once[a], [this, &arcs, a, id]() {
+
+		//The NARC itself has to be read first if the file system is opened lazily; its extension could also be wrong
+
+		if (!load(files[id]) || !table->validTypes[id] || table->magicNumbers[id] != MagicNumber::get<NARC>)
+			return;
+
+		NARC &narc = *(NARC*)resources[table->resources[id]];
+		u32 count = narc.contents.front.files;
+
+		if (!isArchiveRange(*table, id, count, arcs.firstChild[a], arcs.firstResource[a], (u32)resources.size()))
+			return;
+
+		//Only the resources of the sub files are written; those are reserved for this NARC
+		expandArchive(narc, *table, id, arcs.firstChild[a], arcs.firstResource[a], count, memory, stored->ptrs.data(), nullptr, *diagnostics, arcs.named);
+
+		if (!arcs.named)
+			table->addToIndex(arcs.firstChild[a], arcs.firstChild[a] + count);
+	});
+
+	//The NARC could have been expanded by a copy of this file system
+	updateResources(arcs.firstResource[a], table->fileOffsets[id + 1] - table->fileOffsets[id]);
+	return true;
+}
+
+//Copies the resources [first, first + count) that were stored later, so get<T> can find them
+void FileSystem::updateResources(u32 first, u32 count) const {
+
+	if (stored == nullptr || first >= resources.size())
+		return;
+
+	if (count > resources.size() - first)
+		count = (u32)resources.size() - first;
+
+	GenericResourceBase **ptrs = const_cast<GenericResourceBase**>(resources.data());
+
+	std::lock_guard<std::mutex> lock(stored->mutex);
+
+	for (u32 i = first; i < first + count; ++i)
+		ptrs[i] = stored->ptrs[i];
+}
+
+void FileSystem::expandSubtree(u32 i) const {
+
+	if (archives == nullptr)
+		return;
+
+	const FileTable &t = *table;
+	u32 start = t.subtreeStart[i], end = start + t.subtreeSize[i];
+
+	for (u32 archive : archives->archives)
+		if (t.subtreeStart[archive] >= start && t.subtreeStart[archive] < end)
+			expand(files[archive]);
+}
+
+const FileSystem &FileSystem::expandAll() const {
+
+	if (archives != nullptr)
+		for (u32 archive : archives->archives)
+			expand(files[archive]);
+
+	return *this;
+}
+
+void FileSystem::detectTypes() {
+
+	std::unique_lock<std::mutex> lock;
+
+	if (source != nullptr)
+		lock = std::unique_lock<std::mutex>(source->mutex);
+
+	for (u32 i = 0; i < table->size(); ++i)
+		table->detectType(i);
+}
+
+void FileSystem::detectType(const FileSystemObject &fso) {
+
+	u32 id = find(fso);
+
+	std::unique_lock<std::mutex> lock;
+
+	if (source != nullptr)
+		lock = std::unique_lock<std::mutex>(source->mutex);
+
+	table->detectType(id);
 }
 
 void FileSystem::clear() {
 	files.clear();
+	table = std::make_shared<FileTable>();
 	fileC = folderC = 0;
+	source.reset();
+	archives.reset();
+	stored.reset();
 	NArchive::clear();
+	memory = std::make_shared<Arena>();
+	diagnostics = std::make_shared<FileSystemDiagnostics>();
+	palettes = std::make_shared<FileSystemPalettes>();
 }
\ No newline at end of file
@@ -1,15 +1,19 @@
 #pragma once
 
 #include "NTypes2.h"
+#include "RomReader.h"
+#include <memory>
 
 namespace nfs {
 
-	//An object for storing file info 
+	struct FileTable;
+
+	//A file or folder in a FileSystem
+	//This is a view into the file system's FileTable; it is valid as long as the file system is
 	struct FileSystemObject {
 
-		std::string path, name;
-		u32 index, parent, resource, files, folders, count, indexInFolder, fileHint, folderHint;
-		Buffer buffer;
+		const FileTable *table;
+		u32 index;
 
 		bool isFolder() const;
 		bool isFile() const;
@@ -19,34 +23,221 @@ namespace nfs {
 		std::string getExtension() const;
 		bool getMagicNumber(std::string &name, u32 &number) const;
 
-		u32 getFolders() const { return folders; }
-		u32 getFiles() const { return files; }
-		u32 size() const { return count; }
-		u32 getIndex() const { return indexInFolder; }
+		std::string getPath() const;
+		std::string getName() const;
+		u32 getParent() const;
+		u32 getResource() const;
+		Buffer getBuffer() const;			//Only contains the size until the file is loaded (see FileSystem::load)
+		bool isCompressed() const;			//If the file is compressed in the ROM; getBuffer returns the decompressed contents
+		Buffer getStoredBuffer() const;		//Contents as they are stored; compressed if the file is compressed (only contains the size until the file is loaded)
+
+		//Type of the file; detected when the file system is created
+		std::string getType() const;		//Type name (NCLR, TXT, ...)
+		u32 getMagicNumber() const;
+		u32 getTypeId() const;				//Index into ArchiveTypes; u32_MAX if the type isn't supported
+		bool hasValidType() const;
+
+		u32 getFolders() const;
+		u32 getFiles() const;
+		u32 size() const;
+		u32 getIndex() const;				//Position in parent; folders come before files
+	};
+
+	//Stores the files and folders of a FileSystem; one array per field
+	//All names are stored in one array and paths are built from them when needed
+	struct FileTable {
+
+		std::vector<u32> parents;					//u32_MAX for root
+		std::vector<u32> resources;					//u32_MAX for folders, u32_MAX - 1 for root
+		std::vector<Buffer> buffers;
+		std::vector<Buffer> compressed;				//Contents of compressed files as they are stored; a null buffer if the file isn't compressed
+		std::vector<u32> nameOffsets, nameLengths;	//Location of the name in 'names'
+		std::vector<u32> pathHashes;
+		std::vector<u32> indexInFolder;
+
+		std::vector<u32> types;						//Index into typeNames
+		std::vector<u32> magicNumbers, typeIds;
+		std::vector<u8> validTypes;
+
+		std::vector<char> names;
+
+		std::vector<std::string> typeNames;
+		std::unordered_map<std::string, u32> typeNameIds;
+		mutable std::mutex typeMutex;
+
+		//Children of object i are folderChildren[folderOffsets[i] .. folderOffsets[i + 1]]
+		//and fileChildren[fileOffsets[i] .. fileOffsets[i + 1]], both sorted by index
+		std::vector<u32> folderOffsets, folderChildren;
+		std::vector<u32> fileOffsets, fileChildren;
+
+		//Depth-first order of all objects; the subtree of object i is subtree[subtreeStart[i] .. subtreeStart[i] + subtreeSize[i]]
+		std::vector<u32> subtree, subtreeStart, subtreeSize;
+
+		//Hash of path or name to index; hashes can collide, so the strings still have to be compared
+		std::unordered_multimap<u32, u32> pathIndex, nameIndex;
+		mutable std::mutex indexMutex;
+
+		FileTable();
+
+		u32 size() const;
+		void resize(u32 n);
+
+		//Adds a file or folder without a name; returns its index
+		u32 push(u32 parent, u32 resource, Buffer buffer);
+
+		//Names the object; this has to happen after the parent is named
+		void setName(u32 i, const std::string &name);
+
+		//Names the object, but stores the name in arena instead of 'names'
+		//Used by threads that fill in their own part of the table; call moveNames afterwards
+		void setName(u32 i, const std::string &name, std::string &arena);
+
+		//Appends the arena to 'names' and fixes the names of [start, end) to point into it
+		void moveNames(u32 start, u32 end, std::string &arena);
+
+		//Reserves space in 'names' for a name that is only known later; fillName writes it
+		//names doesn't grow once the NARCs are reserved, so the space can be filled by another thread while names is read
+		void reserveName(u32 i, u32 length);
+		void fillName(u32 i, const std::string &name);
+
+		bool isFolder(u32 i) const;
+		bool isRoot(u32 i) const;
+		std::string getName(u32 i) const;
+		std::string getPath(u32 i) const;
+		std::string getExtension(u32 i) const;
+		std::string getTypeName(u32 i) const;
+
+		//Figures out the type from the extension and contents of the file
+		void detectType(u32 i);
+		void detectType(u32 i, const std::string &extension);
+
+		//Builds the lookup maps and child index; called once the table is complete
+		//Only the first 'named' objects are added to the lookup maps; the others are added with addToIndex once they have a name
+		void buildIndex(u32 named = u32_MAX);
+		void addToIndex(u32 start, u32 end);
+
+		//Finds the object with the path; u32_MAX if there is none
+		u32 findPath(const std::string &path) const;
+
+		//Finds all objects with the name, sorted by index
+		std::vector<u32> findName(const std::string &name) const;
+
+		static u32 hash(const char *str, u32 len, u32 start = 2166136261U);
+
+	private:
+
+		void buildChildIndex();
+		u32 getTypeNameId(const std::string &name);
+	};
+
+	//Where the files of a lazily read file system come from (see NType::openNDS and NType::readIndex)
+	//Either the ROM is kept open and file contents are read into 'loaded' the first time they are requested,
+	//or the ROM is in memory and 'loaded' points into it
+	struct FileSystemSource {
+
+		std::unique_ptr<RomReader> reader;		//nullptr if the ROM is in memory
+		Buffer rom;
+		std::mutex mutex;
+		std::vector<u32> offsets;				//Offset of every file in the ROM (by resource id)
+		std::vector<Buffer> loaded;				//Contents of every file that has been read (by resource id)
+		std::vector<u32> sizes;					//Size of the slot that is reserved for every resource (by resource id)
+
+		FileSystemSource(std::string path);
+		FileSystemSource(Buffer rom);
+		~FileSystemSource();
+
+		//Reads 'size' bytes of a file; a null buffer if it is out of bounds or couldn't be read
+		Buffer read(u32 resource, u32 size);
+	};
+
+	//NARCs that are expanded into their sub files the first time they are used (see FileSystemSettings::lazyArchives)
+	//The table already contains the sub files, but they don't have a name, contents or resource until the NARC is expanded
+	struct FileSystemArchives {
+
+		std::vector<u32> archives;						//Index of every NARC in the table
+		std::vector<u32> firstChild, firstResource;		//Where the sub files of every NARC are stored
+		std::unordered_map<u32, u32> byIndex;			//Index in the table to index in archives
+		std::unique_ptr<std::once_flag[]> once;
+		u32 start;										//Index of the first sub file in the table
+		bool named;										//Sub files already have a name, type and buffer; expanding only reads their resources
+
+		FileSystemArchives(u32 count);
+	};
+
+	//Resources that are stored after the file system is created, by resource id (see FileSystem::load and FileSystem::expand)
+	//Every copy of a file system has its own resource pointers, so copies get those resources from here
+	struct FileSystemResources {
+		std::vector<GenericResourceBase*> ptrs;			//nullptr until the resource is stored
+		std::mutex mutex;
+	};
+
+	//A file that couldn't be read as its type; it is stored as an NBUO instead
+	struct FileSystemDiagnostic {
+		u32 file;							//Index of the file in the table
+		u32 magicNumber;					//Type the file was read as
+		const char *reason;
+	};
+
+	//Files that couldn't be read while converting, loading or expanding a FileSystem
+	//Files are added by multiple threads, so they are stored in the order they failed
+	struct FileSystemDiagnostics {
+
+		std::vector<FileSystemDiagnostic> list;
+		std::mutex mutex;
+
+		void add(u32 file, u32 magicNumber, const char *reason);
+	};
+
+	//Palettes of NCLRs that are converted to RGBA8 (see FileSystem::getPalette); by index in the table
+	struct FileSystemPalettes {
+		std::unordered_map<u32, PaletteLUT> byFile;
+		std::mutex mutex;
 	};
 
 	//A bundle of files; different than an archieve
 	//An archieve is a list of files, while this can also contain folders
 	class FileSystem : public NArchive {
 
+		friend struct NType;
+
 	public:
 
-		FileSystem(std::vector<FileSystemObject> &_files, std::vector<GenericResourceBase*> &resources, Buffer buf, u32 folders, u32 files);
+		//The resources of sub files of NARCs and decompressed files are in 'memory' instead of buf; it is created if it is null
+		//Files that couldn't be read are in 'diagnostics'; it is created if it is null
+		FileSystem(std::shared_ptr<FileTable> table, std::vector<GenericResourceBase*> &resources, Buffer buf, u32 folders, u32 files, std::shared_ptr<FileSystemSource> source = nullptr, std::shared_ptr<FileSystemArchives> archives = nullptr, std::shared_ptr<Arena> memory = nullptr, std::shared_ptr<FileSystemDiagnostics> diagnostics = nullptr);
 		FileSystem();
 
+		//Copies share the table, buffer and resources (see NArchive::share)
+		//A NARC that is expanded later is expanded for every copy, so copying doesn't expand anything
+		FileSystem(const FileSystem &other);
+		FileSystem &operator=(const FileSystem &other);
+
+		FileSystem(FileSystem &&other) = default;
+		FileSystem &operator=(FileSystem &&other) = default;
+
 		template<class T>
 		const T &getResource(std::string str) const;
 
 		template<class T>
 		const T &getResource(const FileSystemObject &fso) const;
 		
+		//Views the contents of a file as a T without reading it into a resource (see ResourceView)
+		//Loads the file first if needed; throws if it isn't a T
+		template<class T>
+		ResourceView<T> view(const FileSystemObject &fso) const;
+
+		//Gets the file or folder with the path or name 'str'
+		//When multiple names match, the first one in the file system is returned
 		const FileSystemObject &operator[](std::string str) const;
 
-		//Gets all files and folders in folder
+		//Gets all files and folders with the name 'name'
+		std::vector<const FileSystemObject*> findByName(std::string name) const;
+
+		//Gets all files and folders in folder; folders come first
 		//For getting all files inside of those folders, use traverseFolder(fso)
 		std::vector<const FileSystemObject*> operator[](const FileSystemObject &fso) const;
 
-		//Find all files in folder
+		//Find all files in folder; depth-first, folders before files
 		//bool includeDirs = false
 		//Turn includeDirs to true if you want to include folders
 		std::vector<const FileSystemObject*> traverseFolder(const FileSystemObject &fso, bool includeDirs = false) const;
@@ -61,14 +252,67 @@ namespace nfs {
 		template<class T> bool isFolder(T t);
 		template<class T> bool isRoot(T t);
 
+		//Gets the child at position i in folder; folders come before files
+		//Returns nullptr if i is out of bounds
+		const FileSystemObject *getChild(const FileSystemObject &folder, u32 i) const;
+
+		//Gets the position of fso in its parent; getChild(parent, getChildIndex(fso)) == &fso
+		u32 getChildIndex(const FileSystemObject &fso) const;
+
 		FileSystemObject *foreachInFolder(bool (*f)(const FileSystemObject &fso, u32 i, u32 param), FileSystemObject &start, u32 param);
 
+		//Reads the file's contents and resource if the file system was opened lazily (see NType::openNDS)
+		//getResource and getBuffer do this automatically; until then, fso.getBuffer() only contains the size of the file
+		//Returns false if the file couldn't be read
+		bool load(const FileSystemObject &fso) const;
+
+		//Gets the contents of a file; loads the file first if needed
+		Buffer getBuffer(const FileSystemObject &fso) const;
+
+		//Whether or not file contents are read on demand
+		bool isLazy() const;
+
+		//Expands a NARC into its sub files if that didn't happen while converting (see FileSystemSettings::lazyArchives)
+		//Enumerating the NARC, resolving a path inside of it or loading one of its files does this automatically
+		//Returns false if fso isn't a NARC that is expanded on demand
+		bool expand(const FileSystemObject &fso) const;
+
+		//Gets the palette of an NCLR converted to RGBA8, for convertPT2D and convertTT2D
+		//It is converted the first time and kept until the FileSystem is cleared, so changes to the NCLR after that aren't in it
+		//Throws if the file isn't an NCLR
+		const PaletteLUT &getPalette(const FileSystemObject &fso) const;
+
+		//Files that couldn't be read as their type, sorted by file
+		std::vector<FileSystemDiagnostic> getDiagnostics() const;
+
+		//Prints the path, type and reason of every file that couldn't be read
+		void printDiagnostics() const;
+
+		//Detects the type of every file again (see FileTable::detectType)
+		void detectTypes();
+
+		//Detects the type of a file again
+		void detectType(const FileSystemObject &fso);
+
 		void clear();
 
 	private:
 
-		std::vector<FileSystemObject> files;
+		u32 find(const FileSystemObject &fso) const;
+		u32 lookup(const std::string &str) const;
+		void expandSubtree(u32 i) const;
+		void updateResources(u32 first, u32 count) const;
+		const FileSystem &expandAll() const;
+
+		std::shared_ptr<FileTable> table;
+		std::vector<FileSystemObject> files;		//Views into table
 		u32 folderC, fileC;
+
+		std::shared_ptr<FileSystemSource> source;
+		std::shared_ptr<FileSystemArchives> archives;
+		std::shared_ptr<FileSystemResources> stored;		//Only if files or NARCs are read later
+		std::shared_ptr<FileSystemDiagnostics> diagnostics;
+		std::shared_ptr<FileSystemPalettes> palettes;
 	};
 
 	template<> bool FileSystem::isFile(std::string str);
@@ -93,7 +337,11 @@ namespace nfs {
 				throw(std::exception("Resource is a folder and couldn't be cast to GenericResourceBase"));
 			}
 
-			u32 resource = fso.resource;
+			if (!load(fso)) {
+				throw(std::exception("Resource couldn't be read"));
+			}
+
+			u32 resource = fso.getResource();
 			return get<T>(resource);
 		}
 		catch (std::exception e) {
@@ -112,7 +360,11 @@ namespace nfs {
 				throw(std::exception("Resource is a folder and couldn't be cast to GenericResourceBase"));
 			}
 
-			u32 resource = fso.resource;
+			if (!load(fso)) {
+				throw(std::exception("Resource couldn't be read"));
+			}
+
+			u32 resource = fso.getResource();
 			return get<T>(resource);
 		}
 		catch (std::exception e) {
@@ -120,6 +372,15 @@ namespace nfs {
 		}
 	}
 
+	template<class T>
+	ResourceView<T> FileSystem::view(const FileSystemObject &fso) const {
+
+		if (!fso.isFile())
+			throw(std::exception("Couldn't view a folder"));
+
+		return ResourceView<T>(getBuffer(fso));
+	}
+
 	struct FolderInfo {
 		u32 offset;
 		u16 firstFilePosition;
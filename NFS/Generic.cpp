@@ -1,7 +1,33 @@
 #include "Types.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include "API/stbi/stbi_write.h"
+#include "ThreadPool.h"
+#include <memory>
+
+#if defined(_M_X64) || defined(__x86_64__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+	#define NFS_SSE2
+	#include <immintrin.h>
+
+	#ifdef _MSC_VER
+		#include <intrin.h>
+		#define NFS_TARGET_AVX2
+	#else
+		#define NFS_TARGET_AVX2 __attribute__((target("avx2")))
+	#endif
+#endif
+
+#ifdef _WIN32
+	#define WIN32_LEAN_AND_MEAN
+	#define NOMINMAX
+	#include <Windows.h>
+#else
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
 
 void deleteBuffer(Buffer *b) {
 	if (b->data != NULL) {
@@ -93,16 +119,114 @@ Buffer readFile(std::string str) {
 	}
 
 	fseek(f, 0, SEEK_END);
-	u32 fsize = (u32)ftell(f);
+	long end = ftell(f);
 	fseek(f, 0, SEEK_SET);
 
-	Buffer res = newBuffer1(fsize);
-	fread(res.data, res.size, 1, f);
-	fclose(f);
+	if (end < 0 || (unsigned long)end > 0xFFFFFFFFUL) {
+		printf("Couldn't read file (%s)\n", str.c_str());
+		fclose(f);
+		return nullbuf;
+	}
 
+	//No need to clear the buffer; fread overwrites all of it, or it is thrown away
+	u32 fsize = (u32)end;
+	Buffer res = { (u8*)malloc(fsize), fsize };
+
+	if (fsize != 0 && (res.data == NULL || fread(res.data, res.size, 1, f) != 1)) {
+		printf("Couldn't read file (%s)\n", str.c_str());
+		free(res.data);
+		fclose(f);
+		return nullbuf;
+	}
+
+	fclose(f);
 	return res;
 }
 
+Buffer mapFile(std::string str, FileMapMode mode) {
+	Buffer nullbuf;
+	nullbuf.data = NULL;
+	nullbuf.size = 0;
+
+#ifdef _WIN32
+
+	HANDLE file = CreateFileA(str.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		printf("Couldn't open file (%s)\n", str.c_str());
+		return nullbuf;
+	}
+
+	LARGE_INTEGER fsize;
+	if (!GetFileSizeEx(file, &fsize) || fsize.QuadPart == 0 || fsize.QuadPart > u32_MAX) {
+		printf("Couldn't map file (%s); invalid file size\n", str.c_str());
+		CloseHandle(file);
+		return nullbuf;
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, NULL, mode == FM_COPY_ON_WRITE ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(file);
+
+	if (mapping == NULL) {
+		printf("Couldn't map file (%s)\n", str.c_str());
+		return nullbuf;
+	}
+
+	//The view keeps the mapping alive, so the handle can be closed right away
+	void *ptr = MapViewOfFile(mapping, mode == FM_COPY_ON_WRITE ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mapping);
+
+	if (ptr == NULL) {
+		printf("Couldn't map file (%s)\n", str.c_str());
+		return nullbuf;
+	}
+
+	return { (u8*)ptr, (u32)fsize.QuadPart };
+
+#else
+
+	int file = open(str.c_str(), O_RDONLY);
+	if (file == -1) {
+		printf("Couldn't open file (%s)\n", str.c_str());
+		return nullbuf;
+	}
+
+	struct stat info;
+	if (fstat(file, &info) != 0 || info.st_size == 0 || (u64)info.st_size > u32_MAX) {
+		printf("Couldn't map file (%s); invalid file size\n", str.c_str());
+		close(file);
+		return nullbuf;
+	}
+
+	int protection = mode == FM_COPY_ON_WRITE ? PROT_READ | PROT_WRITE : PROT_READ;
+	int flags = mode == FM_COPY_ON_WRITE ? MAP_PRIVATE : MAP_SHARED;
+
+	//The mapping keeps the file alive, so the descriptor can be closed right away
+	void *ptr = mmap(NULL, (size_t)info.st_size, protection, flags, file, 0);
+	close(file);
+
+	if (ptr == MAP_FAILED) {
+		printf("Couldn't map file (%s)\n", str.c_str());
+		return nullbuf;
+	}
+
+	return { (u8*)ptr, (u32)info.st_size };
+
+#endif
+}
+
+void unmapFile(Buffer *b) {
+	if (b->data == NULL) return;
+
+#ifdef _WIN32
+	UnmapViewOfFile(b->data);
+#else
+	munmap(b->data, b->size);
+#endif
+
+	b->data = NULL;
+	b->size = 0;
+}
+
 char hexChar(u8 i) {
 	if (i < 10) return '0' + i;
 	return 'A' + (i - 10);
@@ -265,29 +389,328 @@ bool storeData(Texture2D t, u32 i, u32 j, u32 val) {
 	return true;
 }
 
+//5-bit channel to 8-bit, rounded; (x * 255 + 15) / 31
+static inline u32 expand5(u32 x) { return (x * 527 + 23) >> 6; }
+
+//8-bit channel to 5-bit, rounded; (x * 31 + 127) / 255
+static inline u32 reduce8(u32 x) { return ((x * 31 + 128) * 257) >> 16; }
+
+static inline u32 bgr5ToRGBA8(u32 c) {
+	return 0xFF000000 | (expand5((c >> 10) & 0x1F) << 16) | (expand5((c >> 5) & 0x1F) << 8) | expand5(c & 0x1F);
+}
+
+static inline u16 rgba8ToBGR5(u32 c) {
+	return (u16)(reduce8(c & 0xFF) | (reduce8((c >> 8) & 0xFF) << 5) | (reduce8((c >> 16) & 0xFF) << 10));
+}
+
 u32 getPixel(Texture2D t, u32 i, u32 j) {
 	u32 dat = fetchData(t, i, j);
 
-	if ((t.tt & 0xF) == BGR5) {
-		u32 b = (u32)(((dat & 0x001F) >>  0) / 31.f * 255);
-		u32 g = (u32)(((dat & 0x03E0) >>  5) / 31.f * 255);
-		u32 r = (u32)(((dat & 0x7C00) >> 10) / 31.f * 255);
-		dat = (0xFF << 24) | (r << 16) | (g << 8) | b;
-	}
+	if ((t.tt & 0xF) == BGR5)
+		dat = bgr5ToRGBA8(dat);
 
 	return dat;
 }
 
+//Reads 'count' pixels that follow each other in memory, starting at pixel 'index'
+template<bool fourBit> static inline void fetchPixels(const Texture2D &t, u32 index, u32 count, u32 *out);
 
-bool setPixel(Texture2D t, u32 i, u32 j, u32 val) {
+template<> inline void fetchPixels<false>(const Texture2D &t, u32 index, u32 count, u32 *out) {
+
+	u64 start = (u64)index * t.stride;
+	u32 available = start >= t.size ? 0 : (u32)((t.size - start) / t.stride);
+
+	if (available < count) {
+		memset(out + available, 0, (count - available) * 4);
+		count = available;
+	}
+
+	const u8 *dat = t.data + start;
+
+	switch (t.stride) {
+
+	case 1:
+		for (u32 k = 0; k < count; ++k)
+			out[k] = dat[k];
+		break;
+
+	case 2:
+		for (u32 k = 0; k < count; ++k)
+			out[k] = dat[k * 2] | (dat[k * 2 + 1] << 8);
+		break;
+
+	case 4:
+		memcpy(out, dat, count * 4);
+		break;
+
+	default:
+		for (u32 k = 0; k < count; ++k) {
+
+			u32 at = 0;
+
+			for (u32 l = 0; l < t.stride; ++l)
+				at |= dat[k * t.stride + l] << l * 8;
+
+			out[k] = at;
+		}
+	}
+}
+
+//Four bit pixels start at the lowest nibble
+template<> inline void fetchPixels<true>(const Texture2D &t, u32 index, u32 count, u32 *out) {
+
+	for (u32 k = 0; k < count; ++k) {
+
+		u32 pixel = index + k;
+		u64 byte = (u64)pixel * t.stride / 2;
+
+		out[k] = byte < t.size ? (t.data[byte] >> (pixel % 2 * 4)) & 0xF : 0;
+	}
+}
+
+//fetchRow for a layout; linear textures are one read, tiled textures one read per tile
+template<bool tiled, bool fourBit> static void fetchRow(const Texture2D &t, u32 i, u32 j, u32 count, u32 *out) {
+
+	if (!tiled) {
+		fetchPixels<fourBit>(t, j * t.width + i, count, out);
+		return;
+	}
+
+	u32 tileRow = j / 8 * (t.width / 8);
+	u32 y = j % 8 * 8;
+
+	for (u32 end = i + count; i < end; ) {
+
+		u32 x = i % 8;
+		u32 n = 8 - x < end - i ? 8 - x : end - i;
+
+		fetchPixels<fourBit>(t, (tileRow + i / 8) * 64 + y + x, n, out);
+
+		out += n;
+		i += n;
+	}
+}
+
+//Reads the 64 pixels of tile (tileX, tileY) of a tiled texture (see getTile) and applies its filter; they follow each other in memory
+static void fetchTile(const Texture2D &t, u32 tileX, u32 tileY, u32 *out) {
+
+	if (t.size == 0 || t.data == nullptr || t.stride > 4) {
+		memset(out, 0, 64 * 4);
+		return;
+	}
+
+	u32 index = (tileY * (t.width / 8) + tileX) * 64;
+
+	if ((t.tt & 0xF00) == B4)
+		fetchPixels<true>(t, index, 64, out);
+	else
+		fetchPixels<false>(t, index, 64, out);
+
+	filterRow(t, 64, out);
+}
+
+void fetchRow(Texture2D t, u32 i, u32 j, u32 count, u32 *out) {
+
+	if (t.size == 0 || t.data == nullptr || t.stride > 4) {
+		memset(out, 0, count * 4);
+		return;
+	}
+
+	bool tiled = (t.tt & 0xF0) == TILED8;
+	bool fourBit = (t.tt & 0xF00) == B4;
+
+	if (tiled)
+		fourBit ? fetchRow<true, true>(t, i, j, count, out) : fetchRow<true, false>(t, i, j, count, out);
+	else
+		fourBit ? fetchRow<false, true>(t, i, j, count, out) : fetchRow<false, false>(t, i, j, count, out);
+}
+
+void filterRow(Texture2D t, u32 count, u32 *row) {
+
+	if ((t.tt & 0xF) != BGR5)
+		return;
+
+	u16 colors[64];
+
+	for (u32 k = 0; k < count; k += 64) {
+
+		u32 n = count - k < 64 ? count - k : 64;
+
+		for (u32 l = 0; l < n; ++l)
+			colors[l] = (u16)row[k + l];
+
+		convertBGR5ToRGBA8(colors, row + k, n);
+	}
+}
+
+static void bgr5ToRGBA8Scalar(const u16 *in, u32 *out, u32 count) {
+	for (u32 i = 0; i < count; ++i)
+		out[i] = bgr5ToRGBA8(in[i]);
+}
+
+static void rgba8ToBGR5Scalar(const u32 *in, u16 *out, u32 count) {
+	for (u32 i = 0; i < count; ++i)
+		out[i] = rgba8ToBGR5(in[i]);
+}
+
+#ifdef NFS_SSE2
+
+//The channels are converted in 16-bit lanes, with the same math as expand5 and reduce8
+
+static void bgr5ToRGBA8SSE2(const u16 *in, u32 *out, u32 count) {
+
+	const __m128i mask = _mm_set1_epi16(0x1F), mul = _mm_set1_epi16(527), add = _mm_set1_epi16(23), alpha = _mm_set1_epi16((short)0xFF00);
+	u32 i = 0;
+
+	for (; i + 8 <= count; i += 8) {
+
+		__m128i c = _mm_loadu_si128((const __m128i*)(in + i));
+
+		__m128i r = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_and_si128(c, mask), mul), add), 6);
+		__m128i g = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_and_si128(_mm_srli_epi16(c, 5), mask), mul), add), 6);
+		__m128i b = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_and_si128(_mm_srli_epi16(c, 10), mask), mul), add), 6);
+
+		__m128i rg = _mm_or_si128(r, _mm_slli_epi16(g, 8));
+		__m128i ba = _mm_or_si128(b, alpha);
+
+		_mm_storeu_si128((__m128i*)(out + i), _mm_unpacklo_epi16(rg, ba));
+		_mm_storeu_si128((__m128i*)(out + i + 4), _mm_unpackhi_epi16(rg, ba));
+	}
+
+	bgr5ToRGBA8Scalar(in + i, out + i, count - i);
+}
+
+static void rgba8ToBGR5SSE2(const u32 *in, u16 *out, u32 count) {
+
+	const __m128i mask = _mm_set1_epi32(0xFF), mul = _mm_set1_epi16(31), add = _mm_set1_epi16(128), div = _mm_set1_epi16(257);
+	u32 i = 0;
+
+	for (; i + 8 <= count; i += 8) {
+
+		__m128i c0 = _mm_loadu_si128((const __m128i*)(in + i));
+		__m128i c1 = _mm_loadu_si128((const __m128i*)(in + i + 4));
+
+		__m128i r = _mm_packs_epi32(_mm_and_si128(c0, mask), _mm_and_si128(c1, mask));
+		__m128i g = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(c0, 8), mask), _mm_and_si128(_mm_srli_epi32(c1, 8), mask));
+		__m128i b = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(c0, 16), mask), _mm_and_si128(_mm_srli_epi32(c1, 16), mask));
+
+		r = _mm_mulhi_epu16(_mm_add_epi16(_mm_mullo_epi16(r, mul), add), div);
+		g = _mm_mulhi_epu16(_mm_add_epi16(_mm_mullo_epi16(g, mul), add), div);
+		b = _mm_mulhi_epu16(_mm_add_epi16(_mm_mullo_epi16(b, mul), add), div);
 
-	if ((t.tt & 0xF) == BGR5) {
-		u32 b = (u32)ceil(((val & 0xFF0000) >> 16) / 255 * 31.f);
-		u32 g = (u32)ceil(((val & 0x00FF00) >>  8) / 255 * 31.f);
-		u32 r = (u32)ceil(((val & 0x0000FF) >>  0) / 255 * 31.f);
-		val = b | (g << 5) | (r << 10);
+		_mm_storeu_si128((__m128i*)(out + i), _mm_or_si128(r, _mm_or_si128(_mm_slli_epi16(g, 5), _mm_slli_epi16(b, 10))));
 	}
 
+	rgba8ToBGR5Scalar(in + i, out + i, count - i);
+}
+
+//AVX2 unpacks and packs within 128-bit lanes, so the pixels are put back in order with a permute
+
+NFS_TARGET_AVX2 static void bgr5ToRGBA8AVX2(const u16 *in, u32 *out, u32 count) {
+
+	const __m256i mask = _mm256_set1_epi16(0x1F), mul = _mm256_set1_epi16(527), add = _mm256_set1_epi16(23), alpha = _mm256_set1_epi16((short)0xFF00);
+	u32 i = 0;
+
+	for (; i + 16 <= count; i += 16) {
+
+		__m256i c = _mm256_loadu_si256((const __m256i*)(in + i));
+
+		__m256i r = _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(_mm256_and_si256(c, mask), mul), add), 6);
+		__m256i g = _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(_mm256_and_si256(_mm256_srli_epi16(c, 5), mask), mul), add), 6);
+		__m256i b = _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(_mm256_and_si256(_mm256_srli_epi16(c, 10), mask), mul), add), 6);
+
+		__m256i rg = _mm256_or_si256(r, _mm256_slli_epi16(g, 8));
+		__m256i ba = _mm256_or_si256(b, alpha);
+
+		__m256i lo = _mm256_unpacklo_epi16(rg, ba), hi = _mm256_unpackhi_epi16(rg, ba);
+
+		_mm256_storeu_si256((__m256i*)(out + i), _mm256_permute2x128_si256(lo, hi, 0x20));
+		_mm256_storeu_si256((__m256i*)(out + i + 8), _mm256_permute2x128_si256(lo, hi, 0x31));
+	}
+
+	bgr5ToRGBA8SSE2(in + i, out + i, count - i);
+}
+
+NFS_TARGET_AVX2 static void rgba8ToBGR5AVX2(const u32 *in, u16 *out, u32 count) {
+
+	const __m256i mask = _mm256_set1_epi32(0xFF), mul = _mm256_set1_epi16(31), add = _mm256_set1_epi16(128), div = _mm256_set1_epi16(257);
+	u32 i = 0;
+
+	for (; i + 16 <= count; i += 16) {
+
+		__m256i c0 = _mm256_loadu_si256((const __m256i*)(in + i));
+		__m256i c1 = _mm256_loadu_si256((const __m256i*)(in + i + 8));
+
+		__m256i r = _mm256_packs_epi32(_mm256_and_si256(c0, mask), _mm256_and_si256(c1, mask));
+		__m256i g = _mm256_packs_epi32(_mm256_and_si256(_mm256_srli_epi32(c0, 8), mask), _mm256_and_si256(_mm256_srli_epi32(c1, 8), mask));
+		__m256i b = _mm256_packs_epi32(_mm256_and_si256(_mm256_srli_epi32(c0, 16), mask), _mm256_and_si256(_mm256_srli_epi32(c1, 16), mask));
+
+		r = _mm256_mulhi_epu16(_mm256_add_epi16(_mm256_mullo_epi16(r, mul), add), div);
+		g = _mm256_mulhi_epu16(_mm256_add_epi16(_mm256_mullo_epi16(g, mul), add), div);
+		b = _mm256_mulhi_epu16(_mm256_add_epi16(_mm256_mullo_epi16(b, mul), add), div);
+
+		__m256i c = _mm256_or_si256(r, _mm256_or_si256(_mm256_slli_epi16(g, 5), _mm256_slli_epi16(b, 10)));
+		_mm256_storeu_si256((__m256i*)(out + i), _mm256_permute4x64_epi64(c, 0xD8));
+	}
+
+	rgba8ToBGR5SSE2(in + i, out + i, count - i);
+}
+
+static bool hasAVX2() {
+
+	#ifdef _MSC_VER
+
+		int info[4];
+		__cpuid(info, 0);
+
+		if (info[0] < 7)
+			return false;
+
+		//The OS also has to save the AVX registers
+
+		__cpuid(info, 1);
+
+		if (!(info[2] & (1 << 27)) || !(info[2] & (1 << 28)) || (_xgetbv(0) & 6) != 6)
+			return false;
+
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+
+	#else
+		return __builtin_cpu_supports("avx2") != 0;
+	#endif
+}
+
+#endif
+
+void convertBGR5ToRGBA8(const u16 *in, u32 *out, u32 count) {
+
+	#ifdef NFS_SSE2
+		static void (*const kernel)(const u16*, u32*, u32) = hasAVX2() ? bgr5ToRGBA8AVX2 : bgr5ToRGBA8SSE2;
+	#else
+		static void (*const kernel)(const u16*, u32*, u32) = bgr5ToRGBA8Scalar;
+	#endif
+
+	kernel(in, out, count);
+}
+
+void convertRGBA8ToBGR5(const u32 *in, u16 *out, u32 count) {
+
+	#ifdef NFS_SSE2
+		static void (*const kernel)(const u32*, u16*, u32) = hasAVX2() ? rgba8ToBGR5AVX2 : rgba8ToBGR5SSE2;
+	#else
+		static void (*const kernel)(const u32*, u16*, u32) = rgba8ToBGR5Scalar;
+	#endif
+
+	kernel(in, out, count);
+}
+
+
+bool setPixel(Texture2D t, u32 i, u32 j, u32 val) {
+
+	if ((t.tt & 0xF) == BGR5)
+		val = rgba8ToBGR5(val);
+
 	return storeData(t, i, j, val);
 }
 
@@ -302,59 +725,259 @@ Texture2D newTexture2(u8 *ptr, u32 width, u32 height, u32 stride, TextureType tt
 }
 
 
+//Clamps a rectangle to a texture of width x height
+static TextureRect clampRect(TextureRect rect, u32 width, u32 height) {
+
+	if (rect.x > width)
+		rect.x = width;
+
+	if (rect.y > height)
+		rect.y = height;
+
+	if (rect.width > width - rect.x)
+		rect.width = width - rect.x;
+
+	if (rect.height > height - rect.y)
+		rect.height = height - rect.y;
+
+	return rect;
+}
+
 Texture2D convertToRGBA8(Texture2D t) {
-	return runPixelShader(getPixel, t, t.width, t.height);
+	return convertToRGBA8(t, { 0, 0, t.width, t.height });
+}
+
+Texture2D convertToRGBA8(Texture2D t, TextureRect rect) {
+
+	rect = clampRect(rect, t.width, t.height);
+	Texture2D res = { rect.width * rect.height * 4, rect.width, rect.height, 4, NORMAL, (u8*)malloc(rect.width * rect.height * 4) };
+
+	//Palettes and other linear BGR555 textures are converted a row at once
+
+	bool bgr5 = t.tt == BGR5 && t.stride == 2 && t.data != nullptr && t.size >= t.width * t.height * 2 && ((size_t)t.data & 1) == 0;
+
+	for (u32 j = 0; j < rect.height; ++j) {
+
+		u32 *row = (u32*)res.data + j * rect.width;
+
+		if (bgr5) {
+			convertBGR5ToRGBA8((const u16*)t.data + (rect.y + j) * t.width + rect.x, row, rect.width);
+			continue;
+		}
+
+		fetchRow(t, rect.x, rect.y + j, rect.width, row);
+		filterRow(t, rect.width, row);
+	}
+
+	return res;
+}
+
+PaletteLUT convertPalette(Texture2D palette) {
+
+	PaletteLUT lut = { palette.width, palette.height, std::vector<u32>((size_t)palette.width * palette.height) };
+
+	for (u32 j = 0; j < palette.height; ++j) {
+		u32 *row = lut.colors.data() + j * palette.width;
+		fetchRow(palette, 0, j, palette.width, row);
+		filterRow(palette, palette.width, row);
+	}
+
+	return lut;
+}
+
+//Color at (x, y) of a palette; like getPixel, x can go into the next row. 0 if it is outside of the palette
+static inline u32 lookupColor(const PaletteLUT &palette, u32 x, u32 y) {
+	u64 i = (u64)y * palette.width + x;
+	return i < palette.colors.size() ? palette.colors[(size_t)i] : 0;
+}
+
+//Color of a tile sample in a palette bank (see convertTT2D)
+static inline u32 lookupBankColor(const PaletteLUT &palette, u32 sample, u32 bank) {
+	return palette.width == 0 ? 0 : lookupColor(palette, sample % palette.width, bank | (sample / palette.width));
 }
 
 Texture2D convertPT2D(PaletteTexture2D pt2d) {
-	return runPixelShader<PaletteTexture2D>([](PaletteTexture2D t, u32 i, u32 j) -> u32 { 
-		u32 sample = getPixel(t.tilemap, i, j);
-		u32 x = sample & 0xF;
-		u32 y = (sample & 0xF0) >> 4;
-		return getPixel(t.palette, x, y);
-	}, pt2d, pt2d.tilemap.width, pt2d.tilemap.height);
+	return convertPT2D(pt2d, convertPalette(pt2d.palette));
+}
+
+Texture2D convertPT2D(PaletteTexture2D pt2d, const PaletteLUT &palette) {
+	return convertPT2D(pt2d, palette, { 0, 0, pt2d.tilemap.width, pt2d.tilemap.height });
+}
+
+Texture2D convertPT2D(PaletteTexture2D pt2d, const PaletteLUT &palette, TextureRect rect) {
+
+	const Texture2D &t = pt2d.tilemap;
+
+	rect = clampRect(rect, t.width, t.height);
+	Texture2D res = { rect.width * rect.height * 4, rect.width, rect.height, 4, NORMAL, (u8*)malloc(rect.width * rect.height * 4) };
+
+	//The color only depends on the lowest byte of a sample, so every sample is looked up once
+
+	u32 colors[256];
+
+	for (u32 sample = 0; sample < 256; ++sample)
+		colors[sample] = lookupColor(palette, sample & 0xF, (sample & 0xF0) >> 4);
+
+	for (u32 j = 0; j < rect.height; ++j) {
+
+		u32 *row = (u32*)res.data + j * rect.width;
+		fetchRow(t, rect.x, rect.y + j, rect.width, row);
+		filterRow(t, rect.width, row);
+
+		for (u32 i = 0; i < rect.width; ++i)
+			row[i] = colors[row[i] & 0xFF];
+	}
+
+	return res;
 }
 
 Texture2D convertTT2D(TiledTexture2D tt2d) {
+	return convertTT2D(tt2d, convertPalette(tt2d.palette));
+}
+
+Texture2D convertTT2D(TiledTexture2D tt2d, const PaletteLUT &palette, u32 threads) {
+	const u32 tc = getTile(tt2d.tilemap);
+	return convertTT2D(tt2d, palette, { 0, 0, tt2d.map.width * tc, tt2d.map.height * tc }, threads);
+}
+
+Texture2D convertTT2D(TiledTexture2D tt2d, const PaletteLUT &palette, nfs::ThreadPool &pool) {
+	const u32 tc = getTile(tt2d.tilemap);
+	return convertTT2D(tt2d, palette, { 0, 0, tt2d.map.width * tc, tt2d.map.height * tc }, pool);
+}
+
+//Renders the map on 'pool'; without a pool, one is started for 'threads' threads (see convertTT2D)
+static Texture2D renderTT2D(TiledTexture2D tt2d, const PaletteLUT &palette, TextureRect rect, nfs::ThreadPool *pool, u32 threads) {
 	
 	const u32 tc = getTile(tt2d.tilemap);
+	const u32 &tw = tt2d.map.width;
+	const u32 &th = tt2d.map.height;
 
-	return runPixelShader<TiledTexture2D>([](TiledTexture2D t, u32 i, u32 j) -> u32 {
+	rect = clampRect(rect, tw * tc, th * tc);
 
-		const u32 tc = getTile(t.tilemap);
-		const u32 &tw = t.map.width;
-		const u32 &th = t.map.height;
+	const u32 width = rect.width, height = rect.height;
+	Texture2D res = { width * height * 4, width, height, 4, NORMAL, (u8*)malloc(width * height * 4) };
 
-		u32 mx = i / tc;							//X index in map
-		u32 my = j / tc;							//Y index in map
+	if (tc == 0 || width == 0 || height == 0)
+		return res;
 
-		u32 tx = i % tc;							//X index in tile
-		u32 ty = j % tc;							//Y index in tile
+	///Read the map tiles that are in the rectangle and convert the palette banks they use
 
-		u32 ptd = getPixel(t.map, mx, my);			//Data of map tile
-		u32 ptt = (ptd & 0x0C00) >> 10;				//Translate
-		u32 ptp = (ptd & 0xF000) >> 12;				//Palette
-		u32 ptm = (ptd & 0x03FF) >>  0;				//Position in tilemap
+	const u32 firstX = rect.x / tc, firstY = rect.y / tc;
+	const u32 mapW = (rect.x + width - 1) / tc - firstX + 1;
+	const u32 mapH = (rect.y + height - 1) / tc - firstY + 1;
 
-		u32 ptmx = ptm % tw;						//X tile position in tilemap
-		u32 ptmy = ptm / tw;						//Y tile position in tilemap
+	std::vector<u32> map((size_t)mapW * mapH);
+	u32 banksUsed = 0;
 
-		if (ptt & 0b10)
-			ty = (tc - 1) - ty;
+	for (u32 my = 0; my < mapH; ++my) {
 
-		if (ptt & 0b1)
-			tx = (tc - 1) - tx;
+		u32 *row = map.data() + my * mapW;
+		fetchRow(tt2d.map, firstX, firstY + my, mapW, row);
+		filterRow(tt2d.map, mapW, row);
 
-		u32 tmx = ptmx * tc + tx;					//X position in tilemap
-		u32 tmy = ptmy * tc + ty;					//Y position in tilemap
+		for (u32 mx = 0; mx < mapW; ++mx)
+			banksUsed |= 1 << ((row[mx] & 0xF000) >> 12);
+	}
+
+	//Colors of the first 256 samples of every bank; bigger samples are looked up directly
+
+	std::vector<u32> banks(16 * 256);
+
+	for (u32 ptp = 0; ptp < 16; ++ptp)
+		if (banksUsed & (1 << ptp))
+			for (u32 tms = 0; tms < 256; ++tms)
+				banks[ptp * 256 + tms] = lookupBankColor(palette, tms, ptp);
+
+	///Render rows of the map; every map tile is decoded once and the part in the rectangle is copied into the texture, flipped if needed
+
+	auto render = [&](u32 first, u32 last, u32 *tile) {
+
+		for (u32 my = first; my < last; ++my)
+			for (u32 mx = 0; mx < mapW; ++mx) {
+
+				u32 ptd = map[my * mapW + mx];				//Data of map tile
+				u32 ptt = (ptd & 0x0C00) >> 10;				//Translate
+				u32 ptp = (ptd & 0xF000) >> 12;				//Palette
+				u32 ptm = (ptd & 0x03FF) >>  0;				//Position in tilemap
+
+				u32 ptmx = ptm % tw;						//X tile position in tilemap
+				u32 ptmy = ptm / tw;						//Y tile position in tilemap
+
+				const u32 *bank = banks.data() + ptp * 256;
+
+				fetchTile(tt2d.tilemap, ptmx, ptmy, tile);
+
+				for (u32 k = 0; k < tc * tc; ++k)
+					tile[k] = tile[k] < 256 ? bank[tile[k]] : lookupBankColor(palette, tile[k], ptp);
+
+				//Part of the tile that is in the rectangle
+
+				u32 tileX = (firstX + mx) * tc, tileY = (firstY + my) * tc;
+
+				u32 x0 = rect.x > tileX ? rect.x - tileX : 0;
+				u32 y0 = rect.y > tileY ? rect.y - tileY : 0;
+				u32 x1 = rect.x + width - tileX < tc ? rect.x + width - tileX : tc;
+				u32 y1 = rect.y + height - tileY < tc ? rect.y + height - tileY : tc;
+
+				for (u32 ty = y0; ty < y1; ++ty) {
+
+					const u32 *src = tile + (ptt & 0b10 ? (tc - 1) - ty : ty) * tc;
+					u32 *dst = (u32*)res.data + (size_t)(tileY + ty - rect.y) * width + (tileX + x0 - rect.x);
 
-		u32 tms = getPixel(t.tilemap, tmx, tmy);	//Tilemap sample
-		u32 tmsx = tms % t.palette.width;
-		u32 tmsy = tms / t.palette.width;
+					if (ptt & 0b1)
+						for (u32 tx = x0; tx < x1; ++tx)
+							*dst++ = src[(tc - 1) - tx];
+					else
+						memcpy(dst, src + x0, (x1 - x0) * 4);
+				}
+			}
+	};
 
-		return getPixel(t.palette, tmsx, ptp | tmsy);
+	//Big rectangles are split into bands of map rows, which are rendered on multiple threads
+	//Small ones are rendered on this thread, since starting threads would take longer
+
+	static const u32 bandRows = 4;
+	u32 bands = (mapH + bandRows - 1) / bandRows;
+
+	std::unique_ptr<nfs::ThreadPool> started;
+
+	if (pool == nullptr) {
+
+		if (threads == 0)
+			threads = width * height >= 256 * 256 ? std::thread::hardware_concurrency() : 1;
+
+		if (threads > bands)
+			threads = bands;
+
+		if (threads > 1) {
+			started = std::make_unique<nfs::ThreadPool>(threads);
+			pool = started.get();
+		}
+	}
+
+	if (pool == nullptr || bands <= 1) {
+		std::vector<u32> tile(tc * tc);
+		render(0, mapH, tile.data());
+		return res;
+	}
+
+	//Every band has its own tile, so calls that share a pool never write the same scratch space
+
+	pool->parallelFor(bands, [&](u32 band, u32) {
+		std::vector<u32> tile(tc * tc);
+		u32 last = (band + 1) * bandRows;
+		render(band * bandRows, last < mapH ? last : mapH, tile.data());
+	});
+
+	return res;
+}
+
+Texture2D convertTT2D(TiledTexture2D tt2d, const PaletteLUT &palette, TextureRect rect, u32 threads) {
+	return renderTT2D(tt2d, palette, rect, nullptr, threads);
+}
 
-	}, tt2d, tt2d.map.width * tc, tt2d.map.height * tc);
+Texture2D convertTT2D(TiledTexture2D tt2d, const PaletteLUT &palette, TextureRect rect, nfs::ThreadPool &pool) {
+	return renderTT2D(tt2d, palette, rect, &pool, 0);
 }
 
 void deleteTexture(Texture2D *t) {
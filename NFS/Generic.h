@@ -57,6 +57,12 @@ typedef struct {
 	u32 size;
 } Buffer;
 
+//How a file is mapped into memory;
+//FM_READ_ONLY shares the pages with every other process mapping the file, FM_COPY_ON_WRITE allows writing into a private copy of the touched pages
+typedef enum {
+	FM_READ_ONLY, FM_COPY_ON_WRITE
+} FileMapMode;
+
 typedef enum {
 	NORMAL = 0,					//Applies no 'filter' to the image, returns the basic data
 	BGR5 = 0x1,					//Applies the BGR5 filter; ensures that the channel uses 5 bits instead of 8
@@ -83,6 +89,17 @@ typedef struct {
 	Texture2D palette, tilemap, map;
 } TiledTexture2D;
 
+//TextureRect is a part of a texture; (x, y) is the top left pixel
+typedef struct {
+	u32 x, y, width, height;
+} TextureRect;
+
+//PaletteLUT holds a palette that is converted to RGBA8 once; colors[y * width + x] is getPixel(palette, x, y)
+typedef struct {
+	u32 width, height;
+	std::vector<u32> colors;
+} PaletteLUT;
+
 ///Create functions
 Buffer newBuffer1(u32 size);																		//Create new empty buffer
 Buffer newBuffer2(u8 *ptr, u32 size);																//Create temporary buffer
@@ -106,22 +123,53 @@ u32 getUInt(Buffer b);
 u32 fetchData(Texture2D t, u32 i, u32 j);									//Gets the pixel data without applying a filter
 u32 getPixel(Texture2D t, u32 i, u32 j);									//Gets the pixel (with appropriate filters and stuff applied)
 
+//Reads 'count' pixels of row j, starting at column i, without applying a filter (like fetchData); pixels outside of the data are 0
+//Tiled textures are read a row of a tile at a time, instead of finding every pixel again
+void fetchRow(Texture2D t, u32 i, u32 j, u32 count, u32 *out);
+void filterRow(Texture2D t, u32 count, u32 *row);							//Applies the filter of the texture to the result of fetchRow (like getPixel)
+
+///Color conversion
+//BGR555 stores red in the lowest 5 bits, RGBA8 in the lowest byte; channels are rounded to the nearest value
+//Uses AVX2 or SSE2 if the CPU supports it
+void convertBGR5ToRGBA8(const u16 *in, u32 *out, u32 count);
+void convertRGBA8ToBGR5(const u32 *in, u16 *out, u32 count);				//Alpha is dropped
+
 //Returns a new texture with the result of the 'pixel shader'
 template<class T = Texture2D> Texture2D runPixelShader(u32(*func)(T, u32, u32), T t, u32 width, u32 height) {
 
 	Texture2D res = { width * height * 4, width, height, 4, NORMAL, (u8*)malloc(width * height * 4) };
 
-	for (u32 i = 0; i < width; ++i)
-		for (u32 j = 0; j < height; ++j)
+	for (u32 j = 0; j < height; ++j)
+		for (u32 i = 0; i < width; ++i)
 			((u32*)res.data)[j * width + i] = func(t, i, j);
 
 	return res;
 }
 
-Texture2D convertToRGBA8(Texture2D t);										//Pixel shader for converting texture into a readable format
+Texture2D convertToRGBA8(Texture2D t);										//Converts a texture into a readable format, a row at a time
 Texture2D convertPT2D(PaletteTexture2D pt2d);							//^^ convertToRGBA8({width, height, palette, texture})
 Texture2D convertTT2D(TiledTexture2D pt2d);								//^^ convertToRGBA8({width, height, palette, tilemap, map})
 
+//Converts a palette to RGBA8, so indexed textures only have to look colors up
+//Convert a palette once and pass it to convertPT2D and convertTT2D when it is used for multiple textures; their palette is ignored then
+PaletteLUT convertPalette(Texture2D palette);
+Texture2D convertPT2D(PaletteTexture2D pt2d, const PaletteLUT &palette);
+
+namespace nfs { class ThreadPool; }
+
+//Maps are rendered a tile at a time; big maps are split into bands of rows that are rendered on 'threads' threads
+//0 uses one per hardware thread for maps of 256x256 pixels or more, and only this thread for smaller maps
+//Pass a pool instead when converting many maps, so the threads are started once
+Texture2D convertTT2D(TiledTexture2D tt2d, const PaletteLUT &palette, u32 threads = 0);
+Texture2D convertTT2D(TiledTexture2D tt2d, const PaletteLUT &palette, nfs::ThreadPool &pool);
+
+//Converts only the pixels in 'rect' (clamped to the texture), so previewing a part of a big texture doesn't convert all of it
+//The result is rect.width x rect.height; only the tiles and rows that are in the rectangle are read
+Texture2D convertToRGBA8(Texture2D t, TextureRect rect);
+Texture2D convertPT2D(PaletteTexture2D pt2d, const PaletteLUT &palette, TextureRect rect);
+Texture2D convertTT2D(TiledTexture2D tt2d, const PaletteLUT &palette, TextureRect rect, u32 threads = 0);
+Texture2D convertTT2D(TiledTexture2D tt2d, const PaletteLUT &palette, TextureRect rect, nfs::ThreadPool &pool);
+
 ///Setters
 bool setUInt(Buffer b, u32 offset, u32 value);
 bool setUShort(Buffer b, u32 offset, u16 value);
@@ -136,6 +184,8 @@ u32 getTile(Texture2D t);													//Returns how the tiles are structured (8x
 
 ///Read functions
 Buffer readFile(std::string str);
+Buffer mapFile(std::string str, FileMapMode mode = FM_COPY_ON_WRITE);			//Map file into memory; pages are only read when they are touched
+void unmapFile(Buffer *b);														//Unmap a buffer created by mapFile (instead of deleteBuffer)
 
 ///Conversion functions
 char hexChar(u8 i);
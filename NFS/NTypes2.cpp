@@ -1,28 +1,81 @@
 #include "NTypes2.h"
+#include "Compression.h"
 using namespace nfs;
 
-NArchive::NArchive(std::vector<GenericResourceBase*> _resources, Buffer _buf) : resources(_resources), buf(_buf) {}
-NArchive::NArchive() {}
-NArchive::~NArchive() { deleteBuffer(&buf); }
+NArchive::NArchive(std::vector<GenericResourceBase*> _resources, Buffer _buf) : resources(std::move(_resources)), buf(_buf) {}
+NArchive::NArchive() : buf({ NULL, 0 }) {}
+NArchive::~NArchive() { clear(); }
 
 NArchive::NArchive(const NArchive &other) {
 	copy(other);
 }
 
+NArchive::NArchive(NArchive &&other) : buf(other.buf), resources(std::move(other.resources)), shared(std::move(other.shared)), memory(std::move(other.memory)) {
+	other.buf = { NULL, 0 };
+	other.resources.clear();
+}
+
 void NArchive::clear() {
+
 	resources.clear();
-	deleteBuffer(&buf);
+	memory.reset();
+
+	if (shared != nullptr) {
+		shared.reset();
+		buf = { NULL, 0 };
+	}
+	else
+		deleteBuffer(&buf);
 }
 
 NArchive &NArchive::operator=(const NArchive &other) {
-	copy(other);
+
+	if (this != &other) {
+		clear();
+		copy(other);
+	}
+
 	return *this;
 }
 
+NArchive &NArchive::operator=(NArchive &&other) {
+
+	if (this != &other) {
+
+		clear();
+
+		buf = other.buf;
+		resources = std::move(other.resources);
+		shared = std::move(other.shared);
+		memory = std::move(other.memory);
+
+		other.buf = { NULL, 0 };
+		other.resources.clear();
+	}
+
+	return *this;
+}
+
+void NArchive::share() {
+
+	if (shared != nullptr || buf.data == NULL)
+		return;
+
+	shared = std::shared_ptr<Buffer>(new Buffer(buf), [](Buffer *b) {
+		deleteBuffer(b);
+		delete b;
+	});
+}
+
+bool NArchive::isShared() const { return shared != nullptr; }
+
 u32 NArchive::getType(u32 i) const {
 	if (i >= resources.size())
 		throw(std::exception("Out of bounds"));
 
+	if (resources[i] == nullptr)
+		throw(std::exception("Resource isn't loaded"));
+
 	u32 mn = resources[i]->header.magicNumber;
 	bool isValid = false;
 	runArchiveFunction<NType::IsValidType>(mn, ArchiveTypes(), &isValid);
@@ -31,7 +84,7 @@ u32 NArchive::getType(u32 i) const {
 }
 
 bool NArchive::copyResource(u32 id, u8 *where, u32 size) {
-	if(id >= resources.size()) return false;
+	if(id >= resources.size() || resources[id] == nullptr) return false;
 
 	memcpy(where, resources[id], size);
 	return true;
@@ -56,6 +109,17 @@ u32 NArchive::bufferSize() const { return buf.size; }
 
 void NArchive::copy(const NArchive &other) {
 
+	//A shared buffer isn't copied, so the resources don't have to be moved either
+
+	memory = other.memory;
+
+	if (other.shared != nullptr) {
+		buf = other.buf;
+		resources = other.resources;
+		shared = other.shared;
+		return;
+	}
+
 	if (other.buf.data != NULL)
 		buf = newBuffer3(other.buf.data, other.buf.size);
 	else
@@ -63,18 +127,61 @@ void NArchive::copy(const NArchive &other) {
 
 	resources = other.resources;
 
-	for (u32 i = 0; i < other.size(); ++i) 
-		resources[i] = (GenericResourceBase*)(((u8*)other.resources[i]) - other.buf.data + buf.data);
+	//Resources outside of the buffer (or not loaded yet) aren't owned by the archive
+
+	for (u32 i = 0; i < other.size(); ++i) {
+
+		u8 *ptr = (u8*)other.resources[i];
+
+		if (ptr >= other.buf.data && ptr < other.buf.data + other.buf.size)
+			resources[i] = (GenericResourceBase*)(ptr - other.buf.data + buf.data);
+	}
 }
 
 NDS NType::readNDS(Buffer buf) {
 	NDS nds;
+
+	if (buf.data == NULL || buf.size < sizeof(nds) - GenericSection_begin)
+		throw(std::exception("Couldn't read NDS; invalid buffer size"));
+
 	memcpy((u8*)(&nds) + GenericSection_begin, buf.data, sizeof(nds) - GenericSection_begin);
 	nds.data = offset(buf, nds.romHeaderSize);
 	return nds;
 }
 
 bool NType::convert(NARC source, NArchive *archieve) {
+	NArchiveFiles files;
+	return convert(source, archieve, files);
+}
+
+Buffer NType::decompressResource(Buffer in, Arena &memory) {
+
+	if (getCompressionType(in) == COMPRESSION_NONE)
+		return in;
+
+	//Only the magic number is decompressed first, since the header can match by accident
+
+	u32 magicNumber = 0;
+	bool valid = false;
+
+	if (!decompress(in, { (u8*)&magicNumber, 4 }))
+		return in;
+
+	runArchiveFunction<IsValidType>(magicNumber, ArchiveTypes(), &valid);
+
+	if (!valid)
+		return in;
+
+	u32 size = getDecompressedSize(in);
+	Buffer out = { memory.alloc(size), size };
+
+	if (!decompress(in, out))
+		return in;
+
+	return out;
+}
+
+bool NType::convert(NARC source, NArchive *archieve, NArchiveFiles &narcFiles, std::shared_ptr<Arena> memory) {
 
 	BTAF &btaf = source.contents.front;
 	u32 files = btaf.files;
@@ -84,6 +191,13 @@ bool NType::convert(NARC source, NArchive *archieve) {
 		return false;
 	}
 
+	if (memory == nullptr)
+		memory = std::make_shared<Arena>();
+
+	narcFiles.contents.assign(files, { nullptr, 0 });
+	narcFiles.compressed.assign(files, 0);
+	narcFiles.errors.assign(files, nullptr);
+
 	u32 bufferSize = 0;
 
 	for (u32 i = 0; i < files; ++i) {
@@ -92,7 +206,11 @@ bool NType::convert(NARC source, NArchive *archieve) {
 		u32 size = getUInt(offset(btaf.data, i * 8 + 4)) - off;
 		u8 *data = source.contents.back.back.front.data.data + off;
 
-		u32 magicNumber = *(u32*)data;
+		Buffer &contents = narcFiles.contents[i];
+		contents = decompressResource({ data, size }, *memory);
+		narcFiles.compressed[i] = contents.data != data;
+
+		u32 magicNumber = getUInt(contents);
 
 		u32 offInBuffer = bufferSize;
 
@@ -107,18 +225,13 @@ bool NType::convert(NARC source, NArchive *archieve) {
 
 	u32 currOff = 0;
 
-	u32 someOtherInt = *(u32*)(source.contents.back.front.data.data + 4);
-
 	Buffer buf = newBuffer1(bufferSize);
 	std::vector<GenericResourceBase*> resources(files);
 
 	for (u32 i = 0; i < files; ++i) {
 
-		u32 off = getUInt(offset(btaf.data, i * 8));
-		u32 size = getUInt(offset(btaf.data, i * 8 + 4)) - off;
-		u8 *data = source.contents.back.back.front.data.data + off;
-
-		u32 magicNumber = *(u32*)data, oMagicNumber = magicNumber;
+		Buffer b = narcFiles.contents[i];
+		u32 magicNumber = getUInt(b);
 
 		u32 offInBuffer = currOff;
 
@@ -128,22 +241,22 @@ bool NType::convert(NARC source, NArchive *archieve) {
 		catch (std::exception e) {}
 
 		u8 *loc = buf.data + offInBuffer;
-		Buffer b = { data, size };
 
 		if (currOff == offInBuffer) {
 			currOff += sizeof(NBUO);
 			magicNumber = 0;
 		}
 
-		try {
-			runArchiveFunction<NFactory>(magicNumber, ArchiveTypes(), (void*)loc, b);
-		}
-		catch (std::exception e) {}
+		runArchiveFunction<TryNFactory>(magicNumber, ArchiveTypes(), (void*)loc, b, &narcFiles.errors[i]);
+
+		if (narcFiles.errors[i] != nullptr)
+			runArchiveFunction<NFactory>(0, ArchiveTypes(), (void*)loc, b);
 
 		resources[i] = (GenericResourceBase*)loc;
 	}
 
-	*archieve = NArchive(resources, buf);
+	*archieve = NArchive(std::move(resources), buf);
+	archieve->memory = memory;
 
 	return true;
 }
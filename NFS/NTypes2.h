@@ -4,7 +4,9 @@
 #include <typeinfo>
 #include <unordered_map>
 #include <exception>
+#include <memory>
 #include "API/LM4000_TypeList/TypeListHelper.h"
+#include "Arena.h"
 
 #define GenericSection_begin sizeof(Buffer)
 
@@ -12,6 +14,13 @@ namespace nfs {
 
 	class FileSystem;
 
+	//Options for converting a ROM to a FileSystem (see NType::convert)
+	struct FileSystemSettings {
+		bool lazyArchives = false;			//Expand NARCs into their sub files the first time they are used, instead of while converting
+		std::string indexPath;				//Index that is loaded instead of parsing the ROM when it matches; it is (re)written otherwise (see NType::readIndex)
+		u32 threads = 0;					//Threads used to read the file table and expand the NARCs; 0 uses one per hardware thread
+	};
+
 	//A generic header used for sections
 	struct GenericSection {
 		Buffer data;
@@ -157,16 +166,22 @@ namespace nfs {
 
 	class NArchive {
 
+		friend struct NType;
+
 	public:
 
 		NArchive(std::vector<GenericResourceBase*> _resources, Buffer _buf);
 		NArchive();
 		~NArchive();
 
+		//Copies the buffer and resources, unless the archive is shared (see share)
 		NArchive(const NArchive &other);
-
 		NArchive &operator=(const NArchive &other);
 
+		//Takes the buffer and resources; 'other' is left empty
+		NArchive(NArchive &&other);
+		NArchive &operator=(NArchive &&other);
+
 		template<class T>
 		T &operator[](u32 i) const;
 
@@ -180,16 +195,28 @@ namespace nfs {
 		u32 size() const;
 		u32 bufferSize() const;
 
+		//Makes copies of this archive share its buffer instead of copying it
+		//The buffer is deleted once the last copy is gone; changes to a resource are visible in every copy
+		void share();
+		bool isShared() const;
+
 		void clear();
 
 	protected:
 
 		void copy(const NArchive &other);
 
-	private:
-
 		Buffer buf;
 		std::vector<GenericResourceBase*> resources;
+		std::shared_ptr<Buffer> shared;			//Owns buf if it is shared
+		std::shared_ptr<Arena> memory;			//Data that isn't in buf, like decompressed files; copies share it
+	};
+
+	//Information about the files of a NARC that was converted (see NType::convert)
+	struct NArchiveFiles {
+		std::vector<Buffer> contents;			//Contents of every file; decompressed if the file was compressed
+		std::vector<u8> compressed;				//Whether the file was compressed
+		std::vector<const char*> errors;		//Reason the file couldn't be read (it is stored as an NBUO instead), or nullptr
 	};
 
 	template<class T>
@@ -204,6 +231,9 @@ namespace nfs {
 		if (i >= resources.size())
 			throw(std::exception("Out of bounds"));
 
+		if (resources[i] == nullptr)
+			throw(std::exception("Resource isn't loaded"));
+
 		T *t = NType::castResource<T>(resources[i]);
 
 		if (t == nullptr)
@@ -217,45 +247,20 @@ namespace nfs {
 	//TypeList with all the archive types
 	typedef lag::TypeList<NARC, NSCR, NCGR, NCLR, NBUO> ArchiveTypes;
 
-	//function type
-	template<typename ... Args>
-	using archive_func = void(Args...);
-
-	//map return type
-	template<typename ... Args>
-	using archive_fp_map = std::unordered_map<u32, archive_func<Args...>*>;
-
-	//archive functions
-	template<typename T, template<typename> typename F, typename ... Args>
-	void genericFunc(Args ... args)
-	{
-		F<T>{}(args...);
-	}
-
+	//Calls F<T>{}(args...) for the type T in the TypeList that has magic number magicNum; nothing is called if there is no such type
+	//The lookup is generated at compile time as a chain of compares against constants, which the compiler turns into a switch
 	template<typename ... Types>
-	struct MakeArchiveFpMapStruct;
-
-	//make function pointer map
-	template<template<typename> typename F, typename ... Args, typename ... Types>
-	archive_fp_map<Args...> makeArchiveFpMap(lag::TypeList<Types...> tl);
+	struct ArchiveDispatch;
 
-	//make static instance of function pointer map and return a reference to it
-	template<template<typename> typename F, typename ... Args, typename ... Types>
-	archive_fp_map<Args...> &getArchiveFpMap(lag::TypeList<Types...> tl)
-	{
-		const static auto fpMap = makeArchiveFpMap<F, Args...>(tl);
-		return (archive_fp_map<Args...> &)fpMap;
-	}
+	template<typename ... Types>
+	constexpr bool hasUniqueMagicNumbers(lag::TypeList<Types...> tl);
 
-	//run a function from the function pointer map
+	//run a function for the type with this magic number
 	template<template<typename> typename F, typename ... Args, typename ... Types>
 	void runArchiveFunction(u32 magicNum, lag::TypeList<Types...> tl, Args ... args)
 	{
-		auto &fpMap = getArchiveFpMap<F, Args...>(tl);
-		auto &fit = fpMap.find(magicNum);
-
-		if (fit != fpMap.end())
-			(*fit).second(args...);
+		static_assert(hasUniqueMagicNumbers(lag::TypeList<Types...>()), "runArchiveFunction requires every type to have a different magic number");
+		ArchiveDispatch<Types...>::template run<F, Args...>(magicNum, args...);
 	}
 
 	///MagicNumbers
@@ -293,12 +298,176 @@ namespace nfs {
 		template<> constexpr static u32 get<BTNF> = 8;
 	};
 
+	///Views
+
+	//Reads the fields of a section straight from its buffer, instead of copying the section into a T
+	//Fields are only read when they are requested and are checked against the size of the section
+	template<typename T>
+	class SectionView {
+
+		static_assert(std::is_base_of<GenericSection, T>::value, "SectionView<T> where T is instanceof GenericSection");
+
+	public:
+
+		//Throws if the buffer doesn't start with a T
+		SectionView(Buffer buf);
+
+		//Reads a field of T; for example view.get(&RAHC::tileDepth)
+		template<typename F>
+		F get(F T::*field) const;
+
+		u32 getMagicNumber() const;
+		u32 getSize() const;				//Size of section; including contents
+
+		Buffer getData() const;				//Contents after the header of the section
+		Buffer getBuffer() const;			//Whole section
+
+	private:
+
+		Buffer buf;
+	};
+
+	//Finds the sections of a resource in its buffer, without copying it into a GenericResource
+	//Sections are only looked up when they are requested
+	template<typename T>
+	class ResourceView;
+
+	template<typename ... args>
+	class ResourceView<GenericResource<args...>> {
+
+	public:
+
+		//Throws if the buffer doesn't start with the header of this resource
+		ResourceView(Buffer buf);
+
+		//Gets the section of type S; throws if the resource doesn't contain it or if it is out of bounds
+		template<typename S>
+		SectionView<S> get() const;
+
+		GenericHeader getHeader() const;
+		Buffer getBuffer() const;
+
+	private:
+
+		Buffer buf;
+	};
+
+	template<typename T>
+	SectionView<T>::SectionView(Buffer _buf) : buf(_buf) {
+
+		const char *error = nullptr;
+
+		if (buf.data == nullptr || buf.size < SectionLength::get<T>)
+			error = "Invalid buffer size";
+		else if (getMagicNumber() != MagicNumber::get<T>)
+			error = "Invalid magicNumber";
+		else if (getSize() < SectionLength::get<T> || getSize() > buf.size)
+			error = "Invalid section size";
+
+		if (error != nullptr)
+			throw(std::exception((std::string("Couldn't view ") + typeid(T).name() + " \"" + error + "\"").c_str()));
+
+		buf.size = getSize();
+	}
+
+	template<typename T>
+	template<typename F>
+	F SectionView<T>::get(F T::*field) const {
+
+		//Fields are stored in the same order as in T, starting after the Buffer of GenericSection (see readGenericStruct)
+		static const T layout{};
+		u32 off = (u32)((const u8*)&(layout.*field) - (const u8*)&layout);
+
+		if (off < GenericSection_begin || off - GenericSection_begin + sizeof(F) > SectionLength::get<T>)
+			throw(std::exception("Field isn't stored in the section"));
+
+		F result;
+		memcpy(&result, buf.data + off - GenericSection_begin, sizeof(F));
+		return result;
+	}
+
+	template<typename T>
+	u32 SectionView<T>::getMagicNumber() const {
+		u32 magicNumber;
+		memcpy(&magicNumber, buf.data, 4);
+		return magicNumber;
+	}
+
+	template<typename T>
+	u32 SectionView<T>::getSize() const {
+		u32 size;
+		memcpy(&size, buf.data + 4, 4);
+		return size;
+	}
+
+	template<typename T>
+	Buffer SectionView<T>::getData() const { return offset(buf, SectionLength::get<T>); }
+
+	template<typename T>
+	Buffer SectionView<T>::getBuffer() const { return buf; }
+
+	template<typename ... args>
+	ResourceView<GenericResource<args...>>::ResourceView(Buffer _buf) : buf(_buf) {
+
+		const char *error = nullptr;
+
+		if (buf.data == nullptr || buf.size < sizeof(GenericHeader))
+			error = "Invalid buffer size";
+		else if (getHeader().magicNumber != MagicNumber::get<GenericResource<args...>>)
+			error = "Invalid magicNumber";
+
+		if (error != nullptr)
+			throw(std::exception((std::string("Couldn't view ") + typeid(GenericResource<args...>).name() + " \"" + error + "\"").c_str()));
+	}
+
+	template<typename ... args>
+	template<typename S>
+	SectionView<S> ResourceView<GenericResource<args...>>::get() const {
+
+		//Sections are stored in the order of args, so the sections before S have to be skipped
+		constexpr u32 id = lag::get_type_index<S>(lag::TypeList<args...>());
+
+		if (id >= getHeader().sections)
+			throw(std::exception("Section isn't present"));
+
+		u32 off = sizeof(GenericHeader);
+
+		for (u32 i = 0; i < id; ++i) {
+
+			u32 size;
+
+			if (off + 8 > buf.size)
+				throw(std::exception("Section is out of bounds"));
+
+			memcpy(&size, buf.data + off + 4, 4);
+
+			if (size < 8 || size > buf.size - off)
+				throw(std::exception("Section is out of bounds"));
+
+			off += size;
+		}
+
+		return SectionView<S>(offset(buf, off));
+	}
+
+	template<typename ... args>
+	GenericHeader ResourceView<GenericResource<args...>>::getHeader() const {
+		GenericHeader header;
+		memcpy(&header, buf.data, sizeof(GenericHeader));
+		return header;
+	}
+
+	template<typename ... args>
+	Buffer ResourceView<GenericResource<args...>>::getBuffer() const { return buf; }
+
 	///Reading NTypes
 
 	struct NType {
 
+		//Reads a section into 'wh'; returns the reason it couldn't be read or nullptr if it could
+		//Doesn't print or throw, so it can be used for files that are expected to fail
 		template<typename T>
-		static bool readGenericStruct(T *wh, Buffer from) {
+		static const char *tryReadGenericStruct(T *wh, Buffer from) {
 
 			static_assert(std::is_base_of<GenericSection, T>::value, "readGenericStruct<T> where T is instanceof GenericResourceBase");
 
@@ -330,8 +499,18 @@ namespace nfs {
 
 		end:
 
-			if (error != nullptr) {
+			if (error != nullptr)
 				memset(wh, 0, sizeof(T));
+
+			return error;
+		}
+
+		template<typename T>
+		static bool readGenericStruct(T *wh, Buffer from) {
+
+			const char *error = tryReadGenericStruct(wh, from);
+
+			if (error != nullptr) {
 				printf("Couldn't read %s; %s\n", typeid(T).name(), error);
 				return false;
 			}
@@ -345,10 +524,10 @@ namespace nfs {
 		template<typename GR, typename First, typename ... Types>
 		struct SectionLoop<GR, First, Types...>
 		{
-			static bool read(GR *ptr, u32 &off, u32 &offsetId, Buffer b, u32 maxSections)
+			static const char *read(GR *ptr, u32 &off, u32 &offsetId, Buffer b, u32 maxSections)
 			{
-				if (!SectionLoop<GR, First>::read(ptr, off, offsetId, b, maxSections))
-					return false;
+				if (const char *error = SectionLoop<GR, First>::read(ptr, off, offsetId, b, maxSections))
+					return error;
 
 				return SectionLoop<GR, Types...>::read(ptr, off, offsetId, b, maxSections);
 			}
@@ -357,26 +536,26 @@ namespace nfs {
 		template<typename GR, typename T>
 		struct SectionLoop<GR, T>
 		{
-			static bool read(GR *ptr, u32 &off, u32 &offsetId, Buffer b, u32 maxSections)
+			static const char *read(GR *ptr, u32 &off, u32 &offsetId, Buffer b, u32 maxSections)
 			{
 				if (maxSections == offsetId)
-					return true;
+					return nullptr;
 
 				T *gs = &ptr->contents.getAt<T>(offsetId);
 
-				if (!readGenericStruct<T>(gs, offset(b, off))) {
-					printf("Couldn't read section %s\n", typeid(T).name());
-					return false;
-				}
+				if (const char *error = tryReadGenericStruct<T>(gs, offset(b, off)))
+					return error;
 
 				off += gs->size;
 				++offsetId;
-				return true;
+				return nullptr;
 			}
 		};
 
+		//Reads a resource into 'wh'; returns the reason it couldn't be read or nullptr if it could
+		//Doesn't print or throw; 'wh' is cleared if it fails
 		template<typename ...args>
-		static bool readGenericResource(GenericResource<args...> *wh, Buffer from) {
+		static const char *tryReadGenericResource(GenericResource<args...> *wh, Buffer from) {
 
 			using T = GenericResource<args...>;
 
@@ -401,18 +580,24 @@ namespace nfs {
 
 			u32 off = 0, offId = 0;
 
-			if (!SectionLoop<GenericResource<args...>, args...>::read(wh, off, offId, offset(from, size), gh->sections)) {
-				error = "Invalid section";
-				goto end;
-			}
+			error = SectionLoop<GenericResource<args...>, args...>::read(wh, off, offId, offset(from, size), gh->sections);
 
 		end:
 
-			if (error != nullptr) {
+			if (error != nullptr)
 				memset(wh, 0, sizeof(T));
 
-				std::string errorstr = "Couldn't read " + std::string(typeid(T).name()) + " \"" + error + "\"";
+			return error;
+		}
 
+		//Reads a resource into 'wh'; throws if it can't be read (see tryReadGenericResource)
+		template<typename ...args>
+		static bool readGenericResource(GenericResource<args...> *wh, Buffer from) {
+
+			const char *error = tryReadGenericResource(wh, from);
+
+			if (error != nullptr) {
+				std::string errorstr = "Couldn't read " + std::string(typeid(GenericResource<args...>).name()) + " \"" + error + "\"";
 				throw(std::exception(errorstr.c_str()));
 				return false;
 			}
@@ -435,6 +620,22 @@ namespace nfs {
 			}
 		};
 
+		//NFactory that doesn't throw; *error is set to the reason the resource couldn't be read, or nullptr
+		template<typename T>
+		struct TryNFactory {
+			void operator()(void *first, Buffer buf, const char **error) {
+				*error = NType::tryReadGenericResource((T*)first, buf);
+			}
+		};
+
+		template<>
+		struct TryNFactory<NBUO> {
+			void operator()(void *first, Buffer buf, const char **error) {
+				NFactory<NBUO>{}(first, buf);
+				*error = nullptr;
+			}
+		};
+
 		template<typename T>
 		struct IsValidType {
 			void operator()(bool *b) {
@@ -456,6 +657,13 @@ namespace nfs {
 			}
 		};
 
+		template<typename T>
+		struct TypeId {
+			void operator()(u32 *result) {
+				*result = lag::get_type_index<T>(ArchiveTypes());
+			}
+		};
+
 		template<typename T>
 		struct BiggestResource {
 			void operator()(u32 *result) {
@@ -466,10 +674,34 @@ namespace nfs {
 
 
 		static bool convert(NARC source, NArchive *archieve);
+
+		//Converts a NARC and gets information about its files
+		//Compressed files are decompressed into 'memory'; if it is null, the archive gets an arena of its own
+		static bool convert(NARC source, NArchive *archieve, NArchiveFiles &files, std::shared_ptr<Arena> memory = nullptr);
+
+		//Decompresses a file if it is a compressed resource of a supported type (see ArchiveTypes) and stores it in 'memory'
+		//Returns 'in' if it isn't, so other compressed files are left alone
+		static Buffer decompressResource(Buffer in, Arena &memory);
 		static bool convert(NCLR source, Texture2D *tex);
 		static bool convert(NCGR source, Texture2D *tex);
 		static bool convert(NSCR source, Texture2D *tex);
-		static bool convert(NDS nds, FileSystem *fs);
+		static bool convert(NDS nds, FileSystem *fs, FileSystemSettings settings = FileSystemSettings());
+
+		//Opens the ROM at 'path' lazily; only the header, file name table and file allocation table are read
+		//File contents are read when they are requested through the FileSystem (getResource, getBuffer or load)
+		//NARCs (by extension) are expanded into their sub files the first time they are used, like FileSystemSettings::lazyArchives; only their headers are read while opening
+		//Only settings.threads is used; it sets the threads that read the file name table
+		static bool openNDS(std::string path, NDS *nds, FileSystem *fs, FileSystemSettings settings = FileSystemSettings());
+
+		//Writes the file table of 'fs' (converted from 'nds') to an index at 'path'; NARCs that aren't expanded yet are expanded first
+		//The index stores the names, types and NARC layout, so they don't have to be parsed again (see readIndex)
+		static bool writeIndex(NDS nds, const FileSystem &fs, std::string path);
+
+		//Loads the file system of 'nds' from the index at 'path'; files are read from nds when they are used (like openNDS)
+		//NARCs are expanded on demand (like FileSystemSettings::lazyArchives), but their sub files are named and can be found right away
+		//The index is matched by the ROM's size, header checksum, file tables and samples of its contents
+		//Returns false if there is no index or it was made for another ROM or version of the library
+		static bool readIndex(NDS nds, FileSystem *fs, std::string path);
 
 		template<typename T>
 		static T *castResource(GenericResourceBase *wh) {
@@ -481,35 +713,38 @@ namespace nfs {
 		static NDS readNDS(Buffer buf);
 	};
 
-	//moved functions from archive function map init
+	//compile time dispatch of runArchiveFunction
 	template<typename First, typename ... Types>
-	struct MakeArchiveFpMapStruct<First, Types...>
+	struct ArchiveDispatch<First, Types...>
 	{
 		template<template<typename> typename F, typename ... Args>
-		static void insert(archive_fp_map<Args...> &map)
+		static void run(u32 magicNum, Args ... args)
 		{
-			archive_func<Args...> *push = &genericFunc<First, F, Args...>;
-			map[MagicNumber::get<First>] = push;
-			MakeArchiveFpMapStruct<Types...>::insert<F>(map);
+			if (magicNum == MagicNumber::get<First>)
+				F<First>{}(args...);
+			else
+				ArchiveDispatch<Types...>::template run<F, Args...>(magicNum, args...);
 		}
 	};
 
-	template<typename First>
-	struct MakeArchiveFpMapStruct<First>
+	template<>
+	struct ArchiveDispatch<>
 	{
 		template<template<typename> typename F, typename ... Args>
-		static void insert(archive_fp_map<Args...> &map)
-		{
-			archive_func<Args...> *push = &genericFunc<First, F, Args...>;
-			map[MagicNumber::get<First>] = push;
-		}
+		static void run(u32 magicNum, Args ... args) {}
 	};
 
-	template<template<typename> typename F, typename ...Args, typename ...Types>
-	archive_fp_map<Args...> makeArchiveFpMap(lag::TypeList<Types...> tl)
+	template<typename ... Types>
+	constexpr bool hasUniqueMagicNumbers(lag::TypeList<Types...> tl)
 	{
-		archive_fp_map<Args...> ret = archive_fp_map<Args...>();
-		MakeArchiveFpMapStruct<Types...>::insert<F, Args...>(ret);
-		return ret;
+		const u32 magic[] = { 0, MagicNumber::get<Types>... };
+		const u32 count = sizeof(magic) / sizeof(magic[0]);
+
+		for (u32 i = 1; i < count; ++i)
+			for (u32 j = i + 1; j < count; ++j)
+				if (magic[i] == magic[j])
+					return false;
+
+		return true;
 	}
 }
\ No newline at end of file
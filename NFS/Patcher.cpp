@@ -5,32 +5,32 @@
 using namespace nfs;
 
 bool Patcher::patch(std::string original, std::string path, std::string out) {
-	Buffer og = readFile(original);
-	Buffer ptc = readFile(path);
+	Buffer og = mapFile(original, FM_READ_ONLY);
+	Buffer ptc = mapFile(path, FM_READ_ONLY);
 
 	if (og.size == 0) {
 		if (ptc.size != 0)
-			deleteBuffer(&ptc);
+			unmapFile(&ptc);
 		return false;
 	}
 
 	if (ptc.size == 0) {
 		if (og.size != 0)
-			deleteBuffer(&og);
+			unmapFile(&og);
 		return false;
 	}
 
 	Buffer output = patch(og, ptc);
 	if (output.size == 0) {
-		deleteBuffer(&og);
-		deleteBuffer(&ptc);
+		unmapFile(&og);
+		unmapFile(&ptc);
 		return false;
 	}
 
 	bool b = writeBuffer(output, out);
 	deleteBuffer(&output);
-	deleteBuffer(&og);
-	deleteBuffer(&ptc);
+	unmapFile(&og);
+	unmapFile(&ptc);
 	return b;
 }
 
@@ -332,31 +332,31 @@ Buffer Patcher::writePatch(Buffer original, Buffer modified) {
 }
 
 bool Patcher::writePatch(std::string original, std::string modified, std::string patch) {
-	Buffer og = readFile(original);
-	Buffer mod = readFile(modified);
+	Buffer og = mapFile(original, FM_READ_ONLY);
+	Buffer mod = mapFile(modified, FM_READ_ONLY);
 
 	if (og.size == 0) {
 		if (mod.size != 0)
-			deleteBuffer(&mod);
+			unmapFile(&mod);
 		return false;
 	}
 
 	if (mod.size == 0) {
 		if (og.size != 0)
-			deleteBuffer(&og);
+			unmapFile(&og);
 		return false;
 	}
 
 	Buffer res = writePatch(og, mod);
 	if (res.size == 0) {
-		deleteBuffer(&mod);
-		deleteBuffer(&og);
+		unmapFile(&mod);
+		unmapFile(&og);
 		return false;
 	}
 
 	bool b = writeBuffer(res, patch);
 	deleteBuffer(&res);
-	deleteBuffer(&og);
-	deleteBuffer(&mod);
+	unmapFile(&og);
+	unmapFile(&mod);
 	return b;
 }
\ No newline at end of file
@@ -0,0 +1,186 @@
+#include "RomReader.h"
+#include <cstring>
+
+#ifdef _WIN32
+	#define WIN32_LEAN_AND_MEAN
+	#define NOMINMAX
+	#include <Windows.h>
+#else
+	#include <sys/stat.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+using namespace nfs;
+
+#ifdef _WIN32
+	#define NFS_NO_HANDLE nullptr
+#else
+	#define NFS_NO_HANDLE -1
+#endif
+
+RomReader::RomReader(std::string path, u32 _blockSize, u32 _blocks) : handle(NFS_NO_HANDLE), fileSize(0), blockSize(_blockSize == 0 ? 0x10000 : _blockSize), useCounter(0), blocks(_blocks) {
+
+	for (Block &b : blocks)
+		b = { u32_MAX, 0, 0, nullptr };
+
+#ifdef _WIN32
+
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		printf("Couldn't open file (%s)\n", path.c_str());
+		return;
+	}
+
+	LARGE_INTEGER fsize;
+	if (!GetFileSizeEx(file, &fsize) || fsize.QuadPart > u32_MAX) {
+		printf("Couldn't open file (%s); invalid file size\n", path.c_str());
+		CloseHandle(file);
+		return;
+	}
+
+	handle = (void*)file;
+	fileSize = (u32)fsize.QuadPart;
+
+#else
+
+	int file = open(path.c_str(), O_RDONLY);
+	if (file == -1) {
+		printf("Couldn't open file (%s)\n", path.c_str());
+		return;
+	}
+
+	struct stat info;
+	if (fstat(file, &info) != 0 || (u64)info.st_size > u32_MAX) {
+		printf("Couldn't open file (%s); invalid file size\n", path.c_str());
+		close(file);
+		return;
+	}
+
+	handle = file;
+	fileSize = (u32)info.st_size;
+
+#endif
+}
+
+RomReader::~RomReader() {
+
+	for (Block &b : blocks)
+		if (b.data != nullptr)
+			free(b.data);
+
+	if (handle == NFS_NO_HANDLE) return;
+
+#ifdef _WIN32
+	CloseHandle((HANDLE)handle);
+#else
+	close(handle);
+#endif
+}
+
+bool RomReader::isOpen() const { return handle != NFS_NO_HANDLE; }
+u32 RomReader::size() const { return fileSize; }
+
+bool RomReader::readDirect(u64 offset, u32 length, u8 *out) {
+
+#ifdef _WIN32
+
+	OVERLAPPED overlapped = {};
+	overlapped.Offset = (DWORD)offset;
+	overlapped.OffsetHigh = (DWORD)(offset >> 32);
+
+	DWORD read = 0;
+	return ReadFile((HANDLE)handle, out, length, &read, &overlapped) && read == length;
+
+#else
+
+	//pread can return less than requested, so keep reading until everything is there
+	while (length > 0) {
+
+		ssize_t read = pread(handle, out, length, (off_t)offset);
+
+		if (read <= 0)
+			return false;
+
+		out += read;
+		offset += (u64)read;
+		length -= (u32)read;
+	}
+
+	return true;
+
+#endif
+}
+
+RomReader::Block *RomReader::getBlock(u32 id) {
+
+	Block *oldest = &blocks[0];
+
+	for (Block &b : blocks)
+		if (b.id == id) {
+			b.lastUse = ++useCounter;
+			return &b;
+		} else if (b.lastUse < oldest->lastUse)
+			oldest = &b;
+
+	if (oldest->data == nullptr)
+		oldest->data = (u8*)malloc(blockSize);
+
+	u64 start = (u64)id * blockSize;
+	u32 size = (u32)(fileSize - start < blockSize ? fileSize - start : blockSize);
+
+	if (!readDirect(start, size, oldest->data)) {
+		oldest->id = u32_MAX;
+		oldest->lastUse = 0;
+		return nullptr;
+	}
+
+	oldest->id = id;
+	oldest->size = size;
+	oldest->lastUse = ++useCounter;
+	return oldest;
+}
+
+bool RomReader::read(u32 offset, u32 length, u8 *out) {
+
+	if (handle == NFS_NO_HANDLE || (u64)offset + length > fileSize)
+		return false;
+
+	if (length == 0)
+		return true;
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	//Big reads would only push everything else out of the cache
+	if (length >= blockSize || blocks.size() == 0)
+		return readDirect(offset, length, out);
+
+	while (length > 0) {
+
+		Block *b = getBlock(offset / blockSize);
+
+		if (b == nullptr)
+			return false;
+
+		u32 start = offset - b->id * blockSize;
+		u32 size = b->size - start < length ? b->size - start : length;
+
+		memcpy(out, b->data + start, size);
+
+		out += size;
+		offset += size;
+		length -= size;
+	}
+
+	return true;
+}
+
+Buffer RomReader::read(u32 offset, u32 length) {
+
+	Buffer b = { (u8*)malloc(length == 0 ? 1 : length), length };
+
+	if (!read(offset, length, b.data))
+		deleteBuffer(&b);
+
+	return b;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "Types.h"
+#include <mutex>
+
+namespace nfs {
+
+	//Reads parts of a file through positional reads, without loading the entire file
+	//Small reads go through a block cache, so reading a lot of small neighbouring parts (like file headers) stays cheap
+	//Reads are thread safe
+	class RomReader {
+
+	public:
+
+		//Opens the file at 'path' for reading
+		//blockSize; size of a cached block, blocks; number of blocks that are kept in the cache
+		RomReader(std::string path, u32 blockSize = 0x10000, u32 blocks = 16);
+		~RomReader();
+
+		RomReader(const RomReader &other) = delete;
+		RomReader &operator=(const RomReader &other) = delete;
+
+		bool isOpen() const;
+		u32 size() const;
+
+		//Reads 'length' bytes at 'offset' into 'out'
+		//Returns false if the range is out of bounds or the file couldn't be read
+		bool read(u32 offset, u32 length, u8 *out);
+
+		//Reads 'length' bytes at 'offset' into a new buffer (null buffer if it couldn't be read)
+		//The buffer has to be deleted with deleteBuffer
+		Buffer read(u32 offset, u32 length);
+
+	private:
+
+		struct Block {
+			u32 id, size;
+			u64 lastUse;
+			u8 *data;
+		};
+
+		bool readDirect(u64 offset, u32 length, u8 *out);
+		Block *getBlock(u32 id);
+
+#ifdef _WIN32
+		void *handle;
+#else
+		int handle;			//File descriptor; -1 if not opened
+#endif
+		u32 fileSize, blockSize;
+		u64 useCounter;
+
+		std::vector<Block> blocks;
+		std::mutex mutex;
+	};
+
+}
@@ -1,7 +1,10 @@
 #ifndef __LIBDLL__
 
+#include "FileSystem.h"
+#include "Timer.h"
 #include <stdio.h>
 #include <algorithm>
+#include <unordered_map>
 using namespace nfs;
 
 void test1(Buffer buf) {
@@ -14,7 +17,7 @@ void test1(Buffer buf) {
 
 		std::vector<const FileSystemObject*> fsos = files[files["fielddata"]];
 		for (u32 i = 0; i < fsos.size(); ++i)
-			printf("%s\n", fsos[i]->path.c_str());
+			printf("%s\n", fsos[i]->getPath().c_str());
 
 
 		for (auto iter = files.begin(); iter != files.end(); ++iter) {
@@ -28,7 +31,7 @@ void test1(Buffer buf) {
 
 				try {
 					const NBUO &nbuo = files.getResource<NBUO>(val);
-					printf("Object: %s (%s)\n", val.path.c_str(), name.c_str());
+					printf("Object: %s (%s)\n", val.getPath().c_str(), name.c_str());
 				}
 				catch (std::exception e) {
 
@@ -36,7 +39,7 @@ void test1(Buffer buf) {
 						const NCLR &nclr = files.getResource<NCLR>(val);
 						Texture2D palette;
 						NType::convert(*const_cast<NCLR*>(&nclr), &palette);
-						std::string outdir = val.path;
+						std::string outdir = val.getPath();
 						outdir = outdir.substr(0, outdir.size() - 1 - val.getExtension().size()) + ".png";
 						std::replace(outdir.begin(), outdir.end(), '/', '-');
 
@@ -46,11 +49,11 @@ void test1(Buffer buf) {
 
 					}
 
-					printf("Supported object: %s (%s)\n", val.path.c_str(), name.c_str());
+					printf("Supported object: %s (%s)\n", val.getPath().c_str(), name.c_str());
 				}
 			}
 			else {
-				printf("Directory: %s\n", val.path.c_str());
+				printf("Directory: %s\n", val.getPath().c_str());
 			}
 		}
 	}
@@ -59,18 +62,75 @@ void test1(Buffer buf) {
 	}
 }
 
+//Dispatch through a function pointer map, the way runArchiveFunction used to work
+template<typename T>
+void resourceSize(u32 *result) {
+	NType::GenericResourceSize<T>{}(result);
+}
+
+//Compares the dispatch cost per file of the old map and runArchiveFunction on a synthetic table of 50k files
+void test6() {
+
+	const u32 files = 50000, passes = 100;
+	const u32 magic[] = { MagicNumber::get<NARC>, MagicNumber::get<NSCR>, MagicNumber::get<NCGR>, MagicNumber::get<NCLR>, 0, 0x12345678 };
+
+	std::vector<u32> table(files);
+
+	u32 seed = 0x1234567;
+	for (u32 i = 0; i < files; ++i) {
+		seed = seed * 1103515245 + 12345;
+		table[i] = magic[(seed >> 16) % (sizeof(magic) / sizeof(magic[0]))];
+	}
+
+	std::unordered_map<u32, void(*)(u32*)> fpMap = {
+		{ MagicNumber::get<NARC>, &resourceSize<NARC> },
+		{ MagicNumber::get<NSCR>, &resourceSize<NSCR> },
+		{ MagicNumber::get<NCGR>, &resourceSize<NCGR> },
+		{ MagicNumber::get<NCLR>, &resourceSize<NCLR> },
+		{ MagicNumber::get<NBUO>, &resourceSize<NBUO> }
+	};
+
+	u32 mapSize = 0, switchSize = 0;
+
+	oi::Timer t;
+
+	for (u32 j = 0; j < passes; ++j)
+		for (u32 i = 0; i < files; ++i) {
+			auto it = fpMap.find(table[i]);
+			if (it != fpMap.end())
+				it->second(&mapSize);
+		}
+
+	t.lap("Map dispatch");
+
+	for (u32 j = 0; j < passes; ++j)
+		for (u32 i = 0; i < files; ++i)
+			runArchiveFunction<NType::GenericResourceSize>(table[i], ArchiveTypes(), &switchSize);
+
+	t.lap("Compile time dispatch");
+	t.stop();
+	t.print();
+
+	if (mapSize != switchSize)
+		printf("Dispatch mismatch: %u != %u\n", mapSize, switchSize);
+}
+
 void test5() {
 
 	std::string path("ROM.nds"); //TODO: !!!
 
-	Buffer buf = readFile(path);
+	Buffer buf = mapFile(path);
 
 	test1(buf);
 
-	deleteBuffer(&buf);
+	unmapFile(&buf);
 }
 
-int main() {
+int main(int argc, char **argv) {
+
+	//The dispatch benchmark only runs when it is asked for
+	if (argc > 1 && std::string(argv[1]) == "--benchmark")
+		test6();
 
 	test5();
 	getchar();
@@ -0,0 +1,217 @@
+#include "ThreadPool.h"
+
+using namespace nfs;
+
+//The pool and queue of the worker that is running on this thread
+static thread_local const ThreadPool *currentPool = nullptr;
+static thread_local u32 currentQueue = 0;
+
+ThreadPool::ThreadPool(u32 threads) : queueCount(threads == 0 ? std::thread::hardware_concurrency() : threads), queued(0), nextQueue(0), stop(false) {
+
+	if (queueCount == 0)
+		queueCount = 1;
+
+	queues = std::unique_ptr<Queue[]>(new Queue[queueCount]);
+	workers.reserve(queueCount);
+
+	for (u32 i = 0; i < queueCount; ++i)
+		workers.push_back(std::thread(&ThreadPool::work, this, i));
+}
+
+ThreadPool::~ThreadPool() {
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stop = true;
+	}
+
+	wake.notify_all();
+
+	for (std::thread &worker : workers)
+		worker.join();
+}
+
+u32 ThreadPool::size() const { return queueCount + 1; }
+
+void ThreadPool::parallelFor(u32 count, std::function<void(u32, u32)> func) {
+
+	Group group(*this);
+
+	for (u32 i = 0; i < count; ++i)
+		group.run([&func, i](u32 thread) { func(i, thread); });
+
+	group.wait();
+}
+
+void ThreadPool::push(Job job) {
+
+	u32 queue = currentPool == this ? currentQueue : nextQueue++ % queueCount;
+
+	//Counted before it is queued, so a worker never takes a task that isn't counted yet
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		++queued;
+	}
+
+	{
+		Queue &q = queues[queue];
+		std::lock_guard<std::mutex> lock(q.mutex);
+		q.jobs.push_back(std::move(job));
+	}
+
+	wake.notify_one();
+}
+
+bool ThreadPool::pop(u32 queue, Job &job) {
+
+	Queue &q = queues[queue];
+	std::lock_guard<std::mutex> lock(q.mutex);
+
+	if (q.jobs.empty())
+		return false;
+
+	job = std::move(q.jobs.back());
+	q.jobs.pop_back();
+	--queued;
+	return true;
+}
+
+bool ThreadPool::steal(u32 queue, Job &job) {
+
+	for (u32 i = 1; i <= queueCount; ++i) {
+
+		u32 j = (queue + i) % queueCount;
+
+		if (j == queue)
+			continue;
+
+		Queue &q = queues[j];
+		std::lock_guard<std::mutex> lock(q.mutex);
+
+		if (q.jobs.empty())
+			continue;
+
+		job = std::move(q.jobs.front());
+		q.jobs.pop_front();
+		--queued;
+		return true;
+	}
+
+	return false;
+}
+
+//Takes the oldest task of 'group' from any queue
+bool ThreadPool::take(const Group *group, Job &job) {
+
+	for (u32 i = 0; i < queueCount; ++i) {
+
+		Queue &q = queues[i];
+		std::lock_guard<std::mutex> lock(q.mutex);
+
+		for (auto it = q.jobs.begin(); it != q.jobs.end(); ++it)
+			if (it->group == group) {
+				job = std::move(*it);
+				q.jobs.erase(it);
+				--queued;
+				return true;
+			}
+	}
+
+	return false;
+}
+
+void ThreadPool::execute(Job &job, u32 thread) {
+
+	Group &group = *job.group;
+
+	try {
+		job.task(thread);
+	}
+	catch (...) {
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if (!group.error)
+			group.error = std::current_exception();
+	}
+
+	job.task = nullptr;
+
+	//The group can be gone as soon as its last task is counted as done
+
+	if (--group.pending == 0) {
+		std::lock_guard<std::mutex> lock(mutex);
+		done.notify_all();
+	}
+}
+
+void ThreadPool::work(u32 queue) {
+
+	currentPool = this;
+	currentQueue = queue;
+
+	while (true) {
+
+		Job job;
+
+		if (pop(queue, job) || steal(queue, job)) {
+			execute(job, queue + 1);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(mutex);
+		wake.wait(lock, [this]() -> bool { return stop || queued > 0; });
+
+		if (stop && queued == 0)
+			return;
+	}
+}
+
+//Group
+
+ThreadPool::Group::Group(ThreadPool &pool) : pool(pool), pending(0) {}
+
+ThreadPool::Group::~Group() {
+
+	try {
+		wait();
+	}
+	catch (...) {}
+}
+
+void ThreadPool::Group::run(Task task) {
+	++pending;
+	pool.push({ std::move(task), this });
+}
+
+void ThreadPool::Group::wait() {
+
+	//A worker that waits keeps its own id, so it doesn't share id 0 with another thread that waits
+
+	u32 thread = currentPool == &pool ? currentQueue + 1 : 0;
+
+	while (pending > 0) {
+
+		Job job;
+
+		if (pool.take(this, job)) {
+			pool.execute(job, thread);
+			continue;
+		}
+
+		//The other tasks of this group are running on other threads
+
+		std::unique_lock<std::mutex> lock(pool.mutex);
+		pool.done.wait(lock, [this]() -> bool { return pending == 0; });
+	}
+
+	std::exception_ptr e;
+
+	{
+		std::lock_guard<std::mutex> lock(pool.mutex);
+		std::swap(e, error);
+	}
+
+	if (e)
+		std::rethrow_exception(e);
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "Types.h"
+#include <functional>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <exception>
+
+namespace nfs {
+
+	//A pool of worker threads that run tasks
+	//Every worker has its own queue; it runs the newest task of its own queue and steals the oldest task of another queue when its own is empty
+	//Tasks added by a worker go to its own queue, other tasks are spread over the queues
+	//Tasks are added through a Group, so multiple threads can use one pool and only wait for their own tasks
+	class ThreadPool {
+
+	public:
+
+		//A task gets the id of the thread that runs it; 0 is a thread that isn't a worker and waits on a group, 1 to size() - 1 are the workers
+		//Only one thread waits on a group, so the threads that run the tasks of one group have different ids
+		//This can be used to give every thread its own scratch space for the tasks of a group
+		typedef std::function<void(u32)> Task;
+
+		//Tasks that are waited on together; a group should only be used by one thread at a time
+		class Group {
+
+		public:
+
+			Group(ThreadPool &pool);
+
+			//Waits for the tasks that are left; their exceptions are lost
+			~Group();
+
+			Group(const Group &other) = delete;
+			Group &operator=(const Group &other) = delete;
+
+			//Adds a task; it is started as soon as a thread is free
+			void run(Task task);
+
+			//Waits until all tasks of this group are done; the calling thread only runs tasks of this group while it waits
+			//If a task of this group threw an exception, the first one is thrown again here
+			//A task can wait on a new group, but not on the group it is part of
+			void wait();
+
+		private:
+
+			friend class ThreadPool;
+
+			ThreadPool &pool;
+			std::atomic<u32> pending;
+			std::exception_ptr error;
+		};
+
+		//Starts 'threads' workers; 0 starts one per hardware thread
+		ThreadPool(u32 threads = 0);
+		~ThreadPool();
+
+		ThreadPool(const ThreadPool &other) = delete;
+		ThreadPool &operator=(const ThreadPool &other) = delete;
+
+		//Number of thread ids a task can get (workers + 1)
+		u32 size() const;
+
+		//Runs func(i, thread) for every i in [0, count) in a new group and waits until all of them are done
+		void parallelFor(u32 count, std::function<void(u32, u32)> func);
+
+	private:
+
+		struct Job {
+			Task task;
+			Group *group;
+		};
+
+		struct Queue {
+			std::deque<Job> jobs;
+			std::mutex mutex;
+		};
+
+		void push(Job job);
+		bool pop(u32 queue, Job &job);
+		bool steal(u32 queue, Job &job);
+		bool take(const Group *group, Job &job);
+		void execute(Job &job, u32 thread);
+		void work(u32 queue);
+
+		std::vector<std::thread> workers;
+		std::unique_ptr<Queue[]> queues;
+		u32 queueCount;
+
+		std::atomic<u32> queued, nextQueue;
+
+		std::mutex mutex;
+		std::condition_variable wake, done;
+		bool stop;
+	};
+
+}
@@ -14,6 +14,11 @@
 #include <qpushbutton.h>
 #include <qdesktopservices.h>
 #include <qmessagebox.h>
+#include <qfileinfo.h>
+#include <qdir.h>
+#include <qstandardpaths.h>
+#include <qcryptographichash.h>
+#include <cstdio>
 #include <Patcher.h>
 using namespace nfs;
 
@@ -43,10 +48,38 @@ void MainWindow::setupRomInfo() {
 		return;
 	}
 
-	rom = NType::readNDS(romData);
+	//readNDS and convert throw if the file isn't a valid ROM; it is closed again, so an empty file system is shown
+	try {
+		rom = NType::readNDS(romData);
+	}
+	catch (std::exception e) {
+		QMessageBox::critical(this, "Open ROM", QString("Couldn't read \"") + QString::fromStdString(fileName) + "\" as an NDS ROM (" + e.what() + ")");
+		memset(&rom, 0, sizeof(rom));
+		unmapFile(&romData);
+		return;
+	}
 
 	setWindowTitle(QString("File System Utilities: ") + rom.title);
-	NType::convert(rom, &fs);
+
+	//The file table is cached, so opening the ROM again doesn't have to parse it
+	//The cache is stored in the user's cache folder (named after the ROM's path) instead of next to the ROM; without one, nothing is cached
+	FileSystemSettings settings;
+
+	QString cache = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+	QString romPath = QFileInfo(QString::fromStdString(fileName)).canonicalFilePath();
+
+	if (!cache.isEmpty() && !romPath.isEmpty() && QDir().mkpath(cache))
+		settings.indexPath = (cache + "/" + QCryptographicHash::hash(romPath.toUtf8(), QCryptographicHash::Sha1).toHex() + ".nfsi").toStdString();
+
+	try {
+		NType::convert(rom, &fs, settings);
+	}
+	catch (std::exception e) {
+		QMessageBox::critical(this, "Open ROM", QString("Couldn't read the file system of \"") + QString::fromStdString(fileName) + "\" (" + e.what() + ")");
+		fs.clear();
+		memset(&rom, 0, sizeof(rom));
+		unmapFile(&romData);
+	}
 
 }
 
@@ -55,11 +88,11 @@ void MainWindow::setup(std::string str) {
 	if (romData.data != nullptr) {			//Clear old ROM
 		fs.clear();
 		memset(&rom, 0, sizeof(rom));
-		deleteBuffer(&romData);
+		unmapFile(&romData);
 	}
 
 	fileName = str;
-	romData = readFile(str);
+	romData = mapFile(str, FM_COPY_ON_WRITE);
 
 	setupRomInfo();
 
@@ -77,8 +110,38 @@ void MainWindow::setup(std::string str) {
 
 	QAction *saveRom = file->addAction("Save ROM");
 	connect(saveRom, &QAction::triggered, this, [&]() {
+
 		QString exp = QFileDialog::getSaveFileName(this, tr("Save file"), "", tr("NDS ROM (*.nds)"));
-		writeBuffer(romData, exp.toStdString());
+
+		if (exp.isEmpty())
+			return;
+
+		//The ROM is mapped; writing into the file that is mapped fails on Windows and truncates the mapped pages on other platforms
+		//So, the ROM is written to a temporary file that replaces the target once the ROM isn't mapped anymore
+
+		std::string target = exp.toStdString(), temp = target + ".tmp";
+
+		if (!writeBuffer(romData, temp)) {
+			QMessageBox::warning(this, "Save ROM", "Couldn't write the ROM to \"" + exp + "\"");
+			return;
+		}
+
+		bool overwritesRom = QFileInfo(exp).canonicalFilePath() == QFileInfo(QString::fromStdString(fileName)).canonicalFilePath();
+
+		if (overwritesRom) {
+			fs.clear();
+			memset(&rom, 0, sizeof(rom));
+			unmapFile(&romData);
+		}
+
+		std::remove(target.c_str());
+
+		if (std::rename(temp.c_str(), target.c_str()) != 0)
+			QMessageBox::warning(this, "Save ROM", "Couldn't replace \"" + exp + "\"; the ROM was saved as \"" + QString::fromStdString(temp) + "\"");
+
+		//The saved ROM has all changes, so it is opened again
+		if (overwritesRom)
+			setup(target);
 	});
 
 	QAction *exp = file->addAction("Export patch");
@@ -87,14 +150,14 @@ void MainWindow::setup(std::string str) {
 		QString exp = QFileDialog::getSaveFileName(this, tr("Export file"), "", tr("Patch file (*.NFSP)"));
 		QString org = QFileDialog::getOpenFileName(this, tr("Original file"), "", tr("NDS ROM (*.nds)"));
 
-		Buffer original = readFile(org.toStdString());
+		Buffer original = mapFile(org.toStdString(), FM_READ_ONLY);
 		if (original.size == 0) {
 			printf("Couldn't read original file\n");
 			return;
 		}
 
 		Buffer dif = nfs::Patcher::writePatch(original, romData);
-		deleteBuffer(&original);
+		unmapFile(&original);
 
 		if (dif.size == 0) {
 			printf("Couldn't create patch\n");
@@ -200,7 +263,7 @@ void MainWindow::setup(std::string str) {
 
 	///Row 1
 	{
-		NExplorer *model = new NExplorer(romData.data, fs);
+		NExplorer *model = new NExplorer(romData, fs);
 		nex = model;
 
 		///Right
@@ -302,5 +365,5 @@ void MainWindow::setup(std::string str) {
 }
 
 MainWindow::~MainWindow() {
-	deleteBuffer(&romData);
+	unmapFile(&romData);
 }
\ No newline at end of file
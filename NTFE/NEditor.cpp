@@ -252,7 +252,7 @@ std::unordered_map<u32, NEditorType> NEditor::__editors() {
 		if (fileName.endsWith(".png", Qt::CaseInsensitive))
 			writeTexture(edit->getBoundTexture(0), fileName.toStdString());
 		else
-			writeBuffer(edit->getBoundFile(0)->buffer, fileName.toStdString());
+			writeBuffer(edit->getBoundFile(0)->getBuffer(), fileName.toStdString());
 	};
 	map[(u32)NEditorMode::PALETTE].load = [](NEditor*) -> void {};
 	map[(u32)NEditorMode::PALETTE].import = [](NEditor*) -> void {};
@@ -305,9 +305,9 @@ std::unordered_map<u32, NEditorType> NEditor::__editors() {
 			deleteTexture(&result);
 		} 
 		else if (fileName.endsWith(".NCGR", Qt::CaseInsensitive)) 
-			writeBuffer(edit->getBoundFile(1)->buffer, fileName.toStdString());
+			writeBuffer(edit->getBoundFile(1)->getBuffer(), fileName.toStdString());
 		else
-			writeBuffer(edit->getBoundFile(0)->buffer, fileName.toStdString());
+			writeBuffer(edit->getBoundFile(0)->getBuffer(), fileName.toStdString());
 	};
 	map[(u32)NEditorMode::TILEMAP].load = [](NEditor*) -> void {};
 	map[(u32)NEditorMode::TILEMAP].import = [](NEditor*) -> void {};
@@ -335,11 +335,11 @@ std::unordered_map<u32, NEditorType> NEditor::__editors() {
 			deleteTexture(&result);
 		}
 		else if (fileName.endsWith(".NCGR", Qt::CaseInsensitive))
-			writeBuffer(edit->getBoundFile(1)->buffer, fileName.toStdString());
+			writeBuffer(edit->getBoundFile(1)->getBuffer(), fileName.toStdString());
 		else if (fileName.endsWith(".NSCR", Qt::CaseInsensitive))
-			writeBuffer(edit->getBoundFile(2)->buffer, fileName.toStdString());
+			writeBuffer(edit->getBoundFile(2)->getBuffer(), fileName.toStdString());
 		else
-			writeBuffer(edit->getBoundFile(0)->buffer, fileName.toStdString());
+			writeBuffer(edit->getBoundFile(0)->getBuffer(), fileName.toStdString());
 	};
 	map[(u32)NEditorMode::MAP].load = [](NEditor*) -> void {};
 	map[(u32)NEditorMode::MAP].import = [](NEditor*) -> void {};
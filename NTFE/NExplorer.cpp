@@ -5,7 +5,7 @@
 #include <qevent.h>
 using namespace nfs;
 
-NExplorer::NExplorer(u8 *_begin, FileSystem &_fs, QObject *parent) : QAbstractItemModel(parent), begin(_begin), fs(_fs), flag(0x7F) { }
+NExplorer::NExplorer(Buffer _rom, FileSystem &_fs, QObject *parent) : QAbstractItemModel(parent), rom(_rom), fs(_fs), flag(0x7F) { }
 
 void NExplorer::setFlag(u32 fl) {
 	flag = fl & 0x7F;
@@ -40,10 +40,7 @@ QVariant NExplorer::data(const QModelIndex &index, int role) const {		//Improve
 
 
 	const FileSystemObject &var = *static_cast<const FileSystemObject*>(index.internalPointer());
-
-	u32 magicNumber;
-	std::string name;
-	bool valid = var.getMagicNumber(name, magicNumber);
+	std::string name = var.getType();
 
 	//TODO: Store those?
 	if (role == Qt::DecorationRole)
@@ -64,7 +61,7 @@ QVariant NExplorer::data(const QModelIndex &index, int role) const {		//Improve
 		else
 			return QPixmap(QString("Resources/Binary.png"));
 
-	return QString(var.name.c_str());
+	return QString(var.getName().c_str());
 }
 
 QModelIndex NExplorer::index(int row, int column, const QModelIndex &parent) const {
@@ -76,9 +73,10 @@ QModelIndex NExplorer::index(int row, int column, const QModelIndex &parent) con
 	else
 		fso = const_cast<FileSystemObject*>(&fs[0]);
 
-	FileSystemObject *child = fs.foreachInFolder([](const FileSystemObject &fso, u32 i, u32 param) -> bool {
-		return i == param;
-	}, *fso, row);
+	if (row < 0)
+		return QModelIndex();
+
+	const FileSystemObject *child = fs.getChild(*fso, (u32)row);
 
 	if (child == nullptr)
 		return QModelIndex();
@@ -92,12 +90,12 @@ QModelIndex NExplorer::parent(const QModelIndex &index) const {
 		return QModelIndex();
 
 	const FileSystemObject &child = *static_cast<const FileSystemObject*>(index.internalPointer());
-	const FileSystemObject &father = fs[child.parent];
+	const FileSystemObject &father = fs[child.getParent()];
 
 	if (father.isRoot())
 		return QModelIndex();
 
-	return createIndex((int)father.getIndex(), 0, (void*)&father);
+	return createIndex((int)fs.getChildIndex(father), 0, (void*)&father);
 }
 
 int NExplorer::rowCount(const QModelIndex &parent) const {
@@ -140,27 +138,37 @@ void NExplorerView::onCustomContextMenu(const QPoint &point) {
 	if (index.isValid()) {
 		fso = (nfs::FileSystemObject*)index.internalPointer();
 
-		u32 magicNumber = 0;
-		std::string name = "";
-		bool valid = fso->getMagicNumber(name, magicNumber);
+		//The offset is only known for files that are stored in the ROM; sub files of a compressed NARC aren't
+		//A file is only loaded when it is used, so it is loaded first
+		std::string offset;
+
+		if (fso->isFile() && nex->fs.load(*fso)) {
+
+			Buffer stored = fso->getStoredBuffer();
+
+			if (stored.data >= nex->rom.data && stored.data < nex->rom.data + nex->rom.size)
+				offset = QString::number(stored.data - nex->rom.data, 16).toStdString();
+		}
+
+		std::string name = fso->getType();
 
 		fileInfo->set("Values", 5, QString::number(fso->index).toStdString());
 		fileInfo->set("Values", 6, fso->isFolder() ? "" : name);
-		fileInfo->set("Values", 7, fso->path);
-		fileInfo->set("Values", 8, fso->isFolder() ? "" : QString::number(fso->buffer.data - nex->begin, 16).toStdString());
-		fileInfo->set("Values", 9, fso->isFolder() ? "" : QString::number(fso->buffer.size).toStdString());
+		fileInfo->set("Values", 7, fso->getPath());
+		fileInfo->set("Values", 8, offset);
+		fileInfo->set("Values", 9, fso->isFolder() ? "" : QString::number(fso->getBuffer().size).toStdString());
 
 		emit fileInfo->dataChanged(QModelIndex(), QModelIndex());
 
 		if (name == "NCLR") {
 			Texture2D tex;
-			nfs::NType::convert(nex->fs.get<nfs::NCLR>(fso->resource), &tex);
+			nfs::NType::convert(nex->fs.getResource<nfs::NCLR>(*fso), &tex);
 
 			editors->setTexture(0, tex, fso);
 		}
 		else if (name == "NCGR") {
 			Texture2D tex;
-			nfs::NCGR ncgr = nex->fs.get<nfs::NCGR>(fso->resource);
+			nfs::NCGR ncgr = nex->fs.getResource<nfs::NCGR>(*fso);
 			nfs::NType::convert(ncgr, &tex);
 
 			///TODO: Calculate correct size of image when it's not specified
@@ -170,7 +178,7 @@ void NExplorerView::onCustomContextMenu(const QPoint &point) {
 		}
 		else if (name == "NSCR") {
 			Texture2D tex;
-			nfs::NSCR ncgr = nex->fs.get<nfs::NSCR>(fso->resource);
+			nfs::NSCR ncgr = nex->fs.getResource<nfs::NSCR>(*fso);
 			nfs::NType::convert(ncgr, &tex);
 
 			editors->setTexture(2, tex, fso);
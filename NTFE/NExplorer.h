@@ -13,7 +13,7 @@ class NExplorer : public QAbstractItemModel {
 
 public:
 
-	explicit NExplorer(u8 *begin, nfs::FileSystem &fs, QObject *parent = 0);
+	explicit NExplorer(Buffer rom, nfs::FileSystem &fs, QObject *parent = 0);
 
 	QVariant data(const QModelIndex &index, int role) const override;
 	Qt::ItemFlags flags(const QModelIndex &index) const override;
@@ -27,7 +27,7 @@ public:
 
 private:
 
-	u8 *begin;
+	Buffer rom;
 	nfs::FileSystem &fs;
 	u32 fileCount;
 